@@ -5,27 +5,73 @@
 
 #include "openvr.h"
 
-namespace hmd {
-	typedef std::shared_ptr<class RenderModel> RenderModelRef;
+#include "ViveChaperone.h"
+#include "ViveDeviceProperties.h"
+#include "ViveEventBus.h"
+#include "ViveFrameContext.h"
+#include "ViveFrameScheduler.h"
+#include "ViveGlInstrument.h"
+#include "ViveHaptics.h"
+#include "ViveJobPool.h"
+#include "ViveMeshOptimizer.h"
+#include "ViveOverlay.h"
+#include "VivePoseHistory.h"
+#include "ViveProgramCache.h"
+#include "ViveRenderModels.h"
+#include "ViveUploadService.h"
 
+namespace hmd {
 	class RenderModel {
 	public:
 		static RenderModelRef create(
 			const std::string & name,
 			const vr::RenderModel_t & vrModel,
 			const vr::RenderModel_TextureMap_t & texture,
-			ci::gl::GlslProgRef shader )
+			GLuint program )
+		{
+			return create( name, optimizeRenderModel( vrModel ), texture, program );
+		}
+		//! \a program decodes the quantized attributes, see HtcVive's model program. It stays owned by the caller.
+		static RenderModelRef create(
+			const std::string & name,
+			const QuantizedMesh & mesh,
+			const vr::RenderModel_TextureMap_t & texture,
+			GLuint program )
+		{
+			return RenderModelRef( new RenderModel{ name, mesh, texture, program } );
+		}
+		//! Wraps buffers and a texture uploaded elsewhere, e.g. by the UploadService; only the VAO, which
+		//! contexts can't share, is created here.
+		static RenderModelRef create(
+			const std::string & name,
+			const QuantizedMesh & mesh,
+			const ci::gl::VboRef & vertexVbo,
+			const ci::gl::VboRef & indexVbo,
+			const ci::gl::Texture2dRef & texture,
+			GLuint program )
 		{
-			return RenderModelRef( new RenderModel{ name, vrModel, texture, shader } );
+			return RenderModelRef( new RenderModel{ name, mesh, vertexVbo, indexVbo, texture, program } );
 		}
-		void draw();
+		//! Binds the raw program through \a gl, so its cached program state stays correct.
+		void draw( GlInstrument& gl );
 		const std::string & GetName() const { return mModelName; }
+		//! Bytes of vertex, index and texture data uploaded for the model.
+		uint64_t getGpuBytes() const { return mGpuBytes; }
 	private:
-		RenderModel( const std::string & name, const vr::RenderModel_t & vrModel, const vr::RenderModel_TextureMap_t & texture, ci::gl::GlslProgRef shader );
-
-		ci::gl::BatchRef		mBatch;
+		RenderModel( const std::string & name, const QuantizedMesh & mesh, const vr::RenderModel_TextureMap_t & texture, GLuint program );
+		RenderModel( const std::string & name, const QuantizedMesh & mesh, const ci::gl::VboRef & vertexVbo, const ci::gl::VboRef & indexVbo, const ci::gl::Texture2dRef & texture, GLuint program );
+		void setupVao();
+
+		ci::gl::VaoRef			mVao;
+		ci::gl::VboRef			mVertexVbo;
+		ci::gl::VboRef			mIndexVbo;
+		GLsizei					mIndexCount;
+		GLuint					mProgram;
+		glm::vec3				mPositionScale, mPositionOffset;
+		glm::vec2				mTexCoordScale, mTexCoordOffset;
 		ci::gl::Texture2dRef	mTexture;
 		std::string				mModelName;
+		uint64_t				mGpuBytes;
 	};
 
 	struct VertexDataLens
@@ -36,8 +82,11 @@ namespace hmd {
 		glm::vec2 texCoordBlue;
 	};
 
+	//! Internal MSAA target and resolve texture of a view, created on its first render.
 	struct FramebufferDesc
 	{
+		FramebufferDesc() : m_nDepthBufferId( 0 ), m_nRenderTextureId( 0 ), m_nRenderFramebufferId( 0 ), m_nResolveFramebufferId( 0 ) {}
+
 		GLuint m_nDepthBufferId;
 		GLuint m_nRenderTextureId;
 		GLuint m_nRenderFramebufferId;
@@ -61,22 +110,263 @@ namespace hmd {
 		bool isValid;
 	};
 
+	//! Describes a view rendered in addition to the two eyes, e.g. a spectator or mixed reality camera.
+	class ViewFormat {
+	public:
+		ViewFormat();
+
+		ViewFormat& size( const glm::uvec2& size ) { mSize = size; return *this; }
+		//! Projection derived from the view size; ignored when projection() is set.
+		ViewFormat& perspective( float fovDegrees, float nearClip, float farClip ) { mFov = fovDegrees; mNearClip = nearClip; mFarClip = farClip; mHasProjection = false; return *this; }
+		ViewFormat& projection( const glm::mat4& projection ) { mProjection = projection; mHasProjection = true; return *this; }
+		//! Follows \a device, offset by \a deviceToCamera. Use k_unTrackedDeviceIndexInvalid for a fixed camera.
+		ViewFormat& attachToDevice( vr::TrackedDeviceIndex_t device, const glm::mat4& deviceToCamera = glm::mat4() ) { mDevice = device; mDeviceToCamera = deviceToCamera; return *this; }
+		//! Renders the view every \a divisor headset frames, e.g. 3 for a 30 Hz spectator at 90 Hz.
+		ViewFormat& updateDivisor( uint32_t divisor ) { mUpdateDivisor = divisor > 0 ? divisor : 1; return *this; }
+
+		const glm::uvec2&			getSize() const { return mSize; }
+		glm::mat4					getProjection() const;
+		vr::TrackedDeviceIndex_t	getDevice() const { return mDevice; }
+		const glm::mat4&			getDeviceToCamera() const { return mDeviceToCamera; }
+		uint32_t					getUpdateDivisor() const { return mUpdateDivisor; }
+
+	private:
+		glm::uvec2					mSize;
+		float						mFov, mNearClip, mFarClip;
+		glm::mat4					mProjection;
+		bool						mHasProjection;
+		vr::TrackedDeviceIndex_t	mDevice;
+		glm::mat4					mDeviceToCamera;
+		uint32_t					mUpdateDivisor;
+	};
+
+	//! Render target and fixed parameters of one view. The eyes are views vr::Eye_Left and vr::Eye_Right.
+	struct ViewState {
+		FramebufferDesc				framebuffer;
+		glm::uvec2					size;
+		glm::mat4					projection;
+		vr::TrackedDeviceIndex_t	device;		// whose pose drives the view, k_unTrackedDeviceIndexInvalid for fixed
+		glm::mat4					deviceToView;	// device space to view space, e.g. head to eye; tracking space to view for fixed cameras
+		uint32_t					updateDivisor;
+	};
+
+	//! Per-frame matrices of one view.
+	struct FrameView {
+		glm::mat4	view;
+		glm::mat4	projection;
+		glm::uvec2	size;
+		bool		active; // rendered this frame
+	};
+
+	//! Eye-independent state captured once per frame and handed to the prepare callbacks.
+	struct FrameState {
+		uint64_t				frameIndex;
+		glm::uvec2				renderSize;
+		glm::mat4				worldPose;
+		glm::mat4				hmdPose;
+		std::vector<FrameView>	views; // indexed like HtcVive views, eyes first
+	};
+
+	struct DrawItem {
+		ci::gl::BatchRef	batch;
+		ci::gl::TextureRef	texture;
+		glm::mat4			modelMatrix;
+		GLsizei				instanceCount; // 0 draws non-instanced
+		float				sortDepth;
+	};
+
+	//! Array of draw items recorded off the render thread and executed on it.
+	class DrawList {
+	public:
+		void clear() { mItems.clear(); }
+		void reserve( size_t count ) { mItems.reserve( count ); }
+		void push( const ci::gl::BatchRef& batch, const glm::mat4& modelMatrix, const ci::gl::TextureRef& texture = nullptr, GLsizei instanceCount = 0 );
+
+		//! Groups items by program and orders each group front to back. Safe to call from a worker thread.
+		void sortFrontToBack( const glm::mat4& viewMatrix );
+		//! Issues the recorded draws. Render thread only.
+		void execute() const;
+
+		size_t size() const { return mItems.size(); }
+		bool empty() const { return mItems.empty(); }
+	private:
+		std::vector<DrawItem> mItems;
+	};
+
 	typedef std::shared_ptr<class HtcVive> HtcViveRef;
 
 	class HtcVive : ci::Noncopyable
 	{
 	public:
-		static HtcViveRef create() { return HtcViveRef{ new HtcVive }; }
+		class Options {
+		public:
+			Options() : mAsynchronous( false ), mBackgroundUploads( false ) {}
+
+			//! Returns from create() right after the runtime is initialized. The remaining stages then run on
+			//! the job pool and, one GL stage per call, in update(); check isReady() before rendering.
+			Options& asynchronous( bool async = true ) { mAsynchronous = async; return *this; }
+			//! Persists linked program binaries in \a directory so later runs skip shader compilation.
+			Options& programCacheDirectory( const ci::fs::path& directory ) { mProgramCacheDirectory = directory; return *this; }
+			//! Called on the render thread once the last stage has completed.
+			Options& readyFn( const std::function<void()>& readyFn ) { mReadyFn = readyFn; return *this; }
+			//! Starts the upload service with create(), so render model and lens buffers are uploaded on its
+			//! shared context while the other stages run.
+			Options& backgroundUploads( bool enable = true ) { mBackgroundUploads = enable; return *this; }
+
+			bool						isAsynchronous() const { return mAsynchronous; }
+			const ci::fs::path&			getProgramCacheDirectory() const { return mProgramCacheDirectory; }
+			const std::function<void()>&	getReadyFn() const { return mReadyFn; }
+			bool						hasBackgroundUploads() const { return mBackgroundUploads; }
+
+		private:
+			bool					mAsynchronous;
+			ci::fs::path			mProgramCacheDirectory;
+			std::function<void()>	mReadyFn;
+			bool					mBackgroundUploads;
+		};
+
+		static HtcViveRef create( const Options& options = Options() ) { return HtcViveRef{ new HtcVive{ options } }; }
 		~HtcVive();
+
+		//! True once every initialization stage has run. Always true after a synchronous create().
+		bool isReady() const { return mInitStage == mInitStages.size(); }
+		//! Becomes ready with initialization, or holds the exception of the stage that failed.
+		std::shared_future<void> getReadyFuture() const { return mReadyFuture; }
+		const ProgramBinaryCache& getProgramCache() const { return mProgramCache; }
 		void update();
 
 		void bind();
 		void unbind();
 
+		//! When enabled, WaitGetPoses runs on a scheduler thread right after each submit, so the app's
+		//! update() overlaps with the compositor wait and bind() only picks up the poses.
+		void setPipelined( bool pipelined );
+		bool isPipelined() const { return mFrameScheduler.isRunning(); }
+		const FrameScheduler& getFrameScheduler() const { return mFrameScheduler; }
+
 		void renderController( const vr::Hmd_Eye& eye );
 		void renderStereoTargets( std::function<void(vr::Hmd_Eye)> renderScene, const glm::mat4& worldPose);
+
+		//! Eye-independent preparation, run once per frame on the render thread.
+		typedef std::function<void( const FrameState& )> PrepareFrameFn;
+		//! Per-eye preparation, run concurrently for both eyes on the job pool. Must not issue GL calls.
+		typedef std::function<void( vr::Hmd_Eye, const FrameState&, DrawList& )> PrepareEyeFn;
+		//! Split variant of renderStereoTargets(): eye lists are recorded in parallel, then submitted in eye order.
+		void renderStereoTargets( const PrepareFrameFn& prepareFrame, const PrepareEyeFn& prepareEye, const glm::mat4& worldPose = glm::mat4() );
 		void renderDistortion( const glm::ivec2& windowSize );
 
+		enum DistortionMode {
+			DISTORTION_MESH,	//!< Rasterizes the 43x43 lens grid per eye.
+			DISTORTION_LOOKUP,	//!< Full-screen pass reading coordinates baked at window resolution, rebaked on resize.
+			DISTORTION_COMPUTE,	//!< Compute shader variant of the lookup pass, blitted to the window. Needs GL 4.3.
+			DISTORTION_MODE_COUNT
+		};
+		enum DistortionQuality {
+			DISTORTION_QUALITY_FULL,		//!< Per-channel coordinates, corrects chromatic aberration.
+			DISTORTION_QUALITY_GREEN_ONLY,	//!< One fetch at the green channel's coordinate, no chromatic aberration correction.
+			DISTORTION_QUALITY_COUNT
+		};
+		struct DistortionTiming {
+			DistortionMode		mode;
+			DistortionQuality	quality;
+			double				gpuMilliseconds;	// per frame, from GL_TIME_ELAPSED
+			double				cpuMilliseconds;	// per frame, to issue the calls
+			double				bakeMilliseconds;	// lookup bake, paid on resize only
+		};
+
+		//! Falls back to DISTORTION_LOOKUP when compute shaders are unavailable.
+		void				setDistortionMode( DistortionMode mode );
+		DistortionMode		getDistortionMode() const { return mDistortionMode; }
+		void				setDistortionQuality( DistortionQuality quality ) { mDistortionQuality = quality; }
+		DistortionQuality	getDistortionQuality() const { return mDistortionQuality; }
+		//! Times every supported mode and quality over \a numFrames frames rendered into an offscreen target
+		//! on the current context. Restores the current mode and quality afterwards.
+		std::vector<DistortionTiming> benchmarkDistortion( const glm::ivec2& windowSize, int numFrames = 100 );
+
+		//! Leaves a checkerboard of 2x2 pixel quads unshaded in the periphery of each eye, where the lens
+		//! compresses the image anyway, and fills them from their neighbors when the eye target is resolved.
+		//! \a radius is in normalized device units from the lens center; \a strength is the fraction of quads
+		//! skipped beyond it, 0.5 for a checkerboard, up to 0.75. Uses the stencil buffer of the eye targets,
+		//! which the scene must leave alone while enabled.
+		void	setRadialDensityMask( bool enabled, float radius = 0.6f, float strength = 0.5f );
+		bool	isRadialDensityMaskEnabled() const { return mDensityMaskEnabled; }
+		float	getRadialDensityMaskRadius() const { return mDensityMaskRadius; }
+		float	getRadialDensityMaskStrength() const { return mDensityMaskStrength; }
+		//! Fraction of an eye's pixels left unshaded with the current settings, 0 while disabled; also counted per frame in GlCallStats::maskedPixels.
+		float	getRadialDensityMaskCoverage() const;
+
+		//! Callback of the monoscopic far field, rendered once per frame from the camera in \a view.
+		typedef std::function<void( const FrameView& view )> RenderFarFieldFn;
+		//! Hybrid variant of renderStereoTargets(): \a renderFarField draws what lies beyond the split distance
+		//! once, from a camera between the eyes, and the result is composited into both eyes behind whatever
+		//! \a renderNearField then draws per eye. The far field callback clears its target like renderScene
+		//! would; the near field one must not clear the color buffer. With the far field disabled both
+		//! callbacks run per eye with the full depth range, far field first.
+		void renderHybridStereoTargets( const RenderFarFieldFn& renderFarField, const std::function<void( vr::Hmd_Eye )>& renderNearField, const glm::mat4& worldPose = glm::mat4() );
+
+		//! Splits renderHybridStereoTargets() at \a splitDistance meters from the eyes. The far field extends to
+		//! \a farClip; it starts \a overlap meters before the split so geometry crossing the split plane leaves
+		//! no crack where the passes meet. Beyond ~25 m the eyes' disparity on the Vive is below a pixel.
+		void	setFarField( bool enabled, float splitDistance = 25.0f, float farClip = 1000.0f, float overlap = 0.5f );
+		bool	isFarFieldEnabled() const { return mFarFieldEnabled; }
+		float	getFarFieldSplitDistance() const { return mFarFieldSplit; }
+		float	getFarFieldFarClip() const { return mFarFieldFarClip; }
+		float	getFarFieldOverlap() const { return mFarFieldOverlap; }
+		//! Center-eye camera of the current frame's far field, valid from the pre-stereo callback on.
+		const FrameView& getFarFieldView() const { return mFarFieldView; }
+
+		enum FieldSplit {
+			FIELD_NEAR = 1,	//!< Only reaches the per-eye near field.
+			FIELD_FAR = 2,	//!< Only reaches the shared far field.
+			FIELD_BOTH = FIELD_NEAR | FIELD_FAR
+		};
+		//! Which pass a world space bounding sphere reaches this frame, so objects entirely on one side of the
+		//! split are only submitted to that pass. Always FIELD_NEAR while the far field is disabled.
+		FieldSplit classifyFarField( const glm::vec3& center, float radius ) const;
+
+		typedef size_t ViewId;
+		typedef std::function<void( ViewId, const FrameView& )> RenderViewFn;
+		typedef std::function<void( ViewId, const FrameState&, DrawList& )> PrepareViewFn;
+
+		//! Adds a view with its own target, resolution and update rate. Returns its index; the eyes are views 0 and 1.
+		ViewId addView( const ViewFormat& format );
+		size_t getNumViews() const { return mViews.size(); }
+		const ViewState& getView( ViewId view ) const { return mViews[view]; }
+		cinder::gl::Texture2dRef getViewTexture( ViewId view ) const { return mViews[view].framebuffer.mResolveTexture; }
+
+		//! Renders every view due this frame, eyes included.
+		void renderViews( const RenderViewFn& renderView, const glm::mat4& worldPose = glm::mat4() );
+		//! Runs \a prepareFrame once for all views, then records the due views in parallel and submits them in order.
+		void renderViews( const PrepareFrameFn& prepareFrame, const PrepareViewFn& prepareView, const glm::mat4& worldPose = glm::mat4() );
+
+		const FrameState& getFrameState() const { return mFrameState; }
+
+		typedef std::function<void( FrameContext& )> PreStereoFn;
+		//! Runs on the render thread once per frame, before any view of renderStereoTargets() or renderViews().
+		//! Shadow maps and other eye-independent passes rendered there through FrameContext::renderPass()
+		//! are read back by the view callbacks via getFrameContext().
+		void setPreStereoFn( const PreStereoFn& preStereoFn ) { mPreStereoFn = preStereoFn; }
+		const FrameContext& getFrameContext() const { return mFrameContext; }
+		FrameContext& getFrameContext() { return mFrameContext; }
+		//! Events polled in update() are dispatched here after the block's own handling.
+		EventBus& getEvents() { return mEvents; }
+		//! Cached tracked device metadata, refreshed from device and property events.
+		const DevicePropertyCache& getDeviceProperties() const { return mDeviceProperties; }
+		//! Chaperone bounds, refreshed from the chaperone events. Overridable with ChaperoneCache::setBounds().
+		ChaperoneCache& getChaperone() { return mChaperone; }
+		//! Distance of every tracked device to the chaperone walls, updated with the poses each frame.
+		const BoundsProximity& getBoundsProximity() const { return mBoundsProximity; }
+		//! Counts the GL and compositor calls made by the block; can be switched to a null backend.
+		GlInstrument& getGlInstrument() { return mGl; }
+		JobPool& getJobPool();
+		//! Worker thread with a GL context shared with the render context, for uploads that would otherwise
+		//! stall a frame. Created on first use, from the render thread, unless Options::backgroundUploads() was set.
+		UploadService& getUploadService();
+
+		//! Creates a compositor overlay of \a size pixels. Dirty overlays are re-rendered and submitted in unbind().
+		OverlayRef createOverlay( const std::string& key, const std::string& name, const glm::ivec2& size, const Overlay::RenderFn& renderFn = nullptr );
+		void destroyOverlay( const OverlayRef& overlay );
+
 		const vr::IVRSystem * getHmd() const { return mHMD; }
 
 		glm::mat4 getHMDMatrixProjectionEye( vr::Hmd_Eye nEye );
@@ -90,14 +380,22 @@ namespace hmd {
 			return mHandControllerState[nEye];
 		}
 
-		cinder::gl::Texture2dRef getEyeTexture(vr::Hmd_Eye nEye = vr::Eye_Left) const {
-			if (nEye == vr::Eye_Left) {
-				return leftEyeDesc.mResolveTexture;
-			}
-			else {
-				return rightEyeDesc.mResolveTexture;
-			}
-		}
+		//! Recent poses of every device, timestamped with their predicted display time. Queries are thread safe.
+		const PoseHistory& getPoseHistory() const { return mPoseHistory; }
+		PoseHistory& getPoseHistory() { return mPoseHistory; }
+
+		//! The texture submitted for \a nEye: the app's, if set, otherwise the resolved internal target.
+		//! Null until either exists.
+		cinder::gl::Texture2dRef getEyeTexture(vr::Hmd_Eye nEye = vr::Eye_Left) const;
+
+		//! Submits \a texture for \a eye in unbind() instead of the internal target, so apps that already
+		//! produce a resolved eye image skip the internal MSAA pass and its resolve blit. \a bounds are
+		//! normalized texture coordinates. Stays in effect until reset with nullptr.
+		void setEyeTexture( vr::Hmd_Eye eye, const ci::gl::Texture2dRef& texture, vr::EColorSpace colorSpace = vr::ColorSpace_Gamma, const ci::Rectf& bounds = ci::Rectf( 0, 0, 1, 1 ) );
+		//! As setEyeTexture(), submitting the first color attachment of \a framebuffer. A multisampled
+		//! \a framebuffer is resolved by Cinder when the texture is fetched, so prefer a single-sampled one.
+		void setEyeFramebuffer( vr::Hmd_Eye eye, const ci::gl::FboRef& framebuffer, vr::EColorSpace colorSpace = vr::ColorSpace_Gamma, const ci::Rectf& bounds = ci::Rectf( 0, 0, 1, 1 ) );
+		bool hasExternalEyeTexture( vr::Hmd_Eye eye ) const { return mEyeSubmissions[eye].texture || mEyeSubmissions[eye].framebuffer; }
 
 		// maximum pulse duration is ~4000 us.
 		void triggerHapticPulse(vr::Hmd_Eye nEye = vr::Eye_Left, unsigned short usDurationMicroSec = 1000) {
@@ -107,21 +405,83 @@ namespace hmd {
 			}
 		}
 
+		//! Models of connected devices, plus unreferenced ones kept within the VRAM budget.
+		RenderModelManager& getRenderModels() { return mRenderModels; }
+
+		//! Waveform playback on a timing thread of its own, started on first use.
+		HapticEngine& getHaptics();
+		//! Queues \a waveform on the hand controller for \a nEye. Returns false if that hand isn't tracked or the queue is full.
+		bool playHapticWaveform( vr::Hmd_Eye nEye, const HapticWaveform& waveform );
+
 		glm::mat4 convertSteamVRMatrixToMat4( const vr::HmdMatrix34_t &matPose );
 		glm::vec3 convertSteamVRVectorToVec3( const vr::HmdVector3_t &vector );
 
 	private:
-		HtcVive();
+		HtcVive( const Options& options );
+
+		//! Runs on the render thread, optionally after a job on the pool has finished.
+		struct InitStage {
+			const char *				name;
+			std::shared_future<void>	dependency;
+			std::function<void()>		fn;
+		};
+
+		void beginInitialization();
+		//! Runs the next GL stage whose dependency is met; \a block waits for it instead. Returns false when none ran.
+		bool pumpInitialization( bool block );
+		void waitForInitJobs();
 
+		void prefetchDevices();
 		void setupShaders();
 		void setupStereoRenderTargets();
+		void buildDistortion();
 		void setupDistortion();
+		GLuint getDistortionProgram( DistortionMode mode, DistortionQuality quality );
+		void bakeDistortionLookup( const glm::ivec2& windowSize );
+		void releaseDistortionLookup();
+		void renderDistortionMesh( const glm::ivec2& windowSize, GLuint program );
+		void renderDistortionLookup( const glm::ivec2& windowSize, GLuint program );
+		void renderDistortionCompute( const glm::ivec2& windowSize, GLuint program );
 		void setupCameras();
 		void setupRenderModels();
 		void setupRenderModelForTrackedDevice( vr::TrackedDeviceIndex_t unTrackedDeviceIndex );
+		void releaseRenderModelForTrackedDevice( vr::TrackedDeviceIndex_t unTrackedDeviceIndex );
 		void setupCompositor();
 
-		RenderModelRef findOrLoadRenderModel( const std::string& name );
+		struct DecodedRenderModel;
+		//! Blocks on the runtime and optimizes the mesh, so it runs on the job pool. Queues the uploads to \a uploads
+		//! if given. nullptr if the runtime failed to load the model.
+		static std::unique_ptr<DecodedRenderModel> decodeRenderModel( const std::string& name, UploadService *uploads );
+		//! Queues the decode of \a name unless it is decoded or already queued.
+		void requestRenderModelDecode( const std::string& name );
+		//! Collects finished decodes and sets up the devices that were waiting for them.
+		void pumpRenderModelDecodes();
+		RenderModelRef loadRenderModel( const std::string& name );
+
+		void updateFrameState( const glm::mat4& worldPose );
+		//! Creates the internal target of \a view unless it exists.
+		void ensureViewFramebuffer( ViewId view );
+		//! Updates the frame state and context, then runs the pre-stereo callback. A non-zero \a eyeFarClip
+		//! replaces the far clip of the eye projections first, so the callback culls against what is rendered.
+		void beginFrame( const glm::mat4& worldPose, float eyeFarClip = 0 );
+		void renderView( ViewId view, const std::function<void()>& draw );
+		//! Writes the density mask of \a eye into the stencil buffer of its bound render target.
+		void renderDensityMask( vr::Hmd_Eye eye );
+		//! Resolves \a eye into its resolve texture, reconstructing the masked pixels.
+		void resolveDensityMask( vr::Hmd_Eye eye );
+		void setDensityMaskUniforms( GLuint program, vr::Hmd_Eye eye );
+		void updateDensityMaskCoverage();
+		glm::mat4 getProjectionEye( vr::Hmd_Eye eye, float nearClip, float farClip ) const;
+		void updateFarFieldView();
+		//! Creates the composite program on first use. Returns false, disabling the far field, if it can't be.
+		bool ensureFarFieldProgram();
+		//! Renders the far field into its frame context pass.
+		void renderFarFieldPass( const RenderFarFieldFn& renderFarField );
+		//! Draws the far field into the bound target of \a eye and resets its depth for the near field.
+		void compositeFarField( vr::Hmd_Eye eye );
+		void renderPreparedViews( const PrepareFrameFn& prepareFrame, const PrepareViewFn& prepareView, ViewId viewCount );
+		void beginStereoPass();
+		void endStereoPass();
 
 		void processVREvent( const vr::VREvent_t & event );
 
@@ -147,9 +507,9 @@ namespace hmd {
 
 		HandControllerState mHandControllerState[2];
 
-		GLuint m_unLensVAO;
-		GLuint m_glIDVertBuffer;
-		GLuint m_glIDIndexBuffer;
+		ci::gl::VaoRef mLensVao;
+		ci::gl::VboRef mLensVbo;
+		ci::gl::VboRef mLensIbo;
 		unsigned int m_uiIndexSize;
 
 		GLuint m_glControllerVertBuffer;
@@ -157,15 +517,37 @@ namespace hmd {
 		unsigned int m_uiControllerVertcount;
 
 		glm::mat4 m_mat4HMDPose;
-		glm::mat4 m_mat4eyePosLeft;
-		glm::mat4 m_mat4eyePosRight;
-
 		glm::mat4 m_mat4ProjectionCenter;
-		glm::mat4 m_mat4ProjectionLeft;
-		glm::mat4 m_mat4ProjectionRight;
 
-		ci::gl::GlslProgRef mGlslLens;
-		ci::gl::GlslProgRef mGlslModel;
+		DistortionMode mDistortionMode;
+		DistortionQuality mDistortionQuality;
+		GLuint mDistortionPrograms[DISTORTION_MODE_COUNT][DISTORTION_QUALITY_COUNT]; // created on first use, except the default
+		GLuint mLookupBakeProgram;
+		GLuint mLookupFramebuffer;
+		GLuint mComputeFramebuffer;
+		bool mDensityMaskEnabled;
+		float mDensityMaskRadius;
+		float mDensityMaskStrength;
+		GLuint mDensityMaskProgram;			// created on first use
+		GLuint mDensityReconstructProgram;
+		uint64_t mDensityMaskPixels[2];		// per eye, for the current settings
+		bool mFarFieldEnabled;
+		float mFarFieldSplit;
+		float mFarFieldFarClip;
+		float mFarFieldOverlap;
+		FrameView mFarFieldView;
+		GLuint mFarFieldCompositeProgram;	// created on first use
+		glm::ivec2 mLookupSize;
+		ci::gl::Texture2dRef mLookupGreenMask;	// green coordinate and bounds mask
+		ci::gl::Texture2dRef mLookupRedBlue;	// red and blue coordinates
+		ci::gl::Texture2dRef mComputeTarget;
+		ci::gl::VaoRef mEmptyVao;				// full-screen passes generate their vertices
+		GLuint mModelProgram;					// shared by every RenderModel
+		ProgramBinaryCache mProgramCache;
+
+		std::vector<VertexDataLens> mLensVertices;	// built on the job pool, released after upload
+		std::vector<GLushort> mLensIndices;
+		std::shared_future<ci::gl::VboRef> mLensVboUpload, mLensIboUpload;	// instead of the above with background uploads
 
 		GLint m_nControllerMatrixLocation;
 
@@ -174,13 +556,62 @@ namespace hmd {
 		int m_iValidPoseCount;
 		int m_iValidPoseCount_Last;
 
-		FramebufferDesc leftEyeDesc;
-		FramebufferDesc rightEyeDesc;
+		std::vector<ViewState> mViews; // eyes first, then extra views
 		glm::uvec2 mRenderSize;
 
-		std::vector<RenderModelRef> mRenderModels;
-		std::array<RenderModelRef, vr::k_unMaxTrackedDeviceCount> mTrackedDeviceToRenderModel;
-
+		RenderModelManager mRenderModels;
+		// decoded off the render thread, during initialization or later on request, consumed by loadRenderModel()
+		struct DecodedRenderModel {
+			DecodedRenderModel() : texture( nullptr ) {}
+
+			QuantizedMesh					mesh;
+			vr::RenderModel_TextureMap_t *	texture;	// null once handed to the upload service
+			std::shared_future<ci::gl::VboRef>			vertexUpload, indexUpload;
+			std::shared_future<ci::gl::Texture2dRef>	textureUpload;
+		};
+		std::map<std::string, DecodedRenderModel> mDecodedRenderModels;
+		std::map<std::string, std::future<std::unique_ptr<DecodedRenderModel>>> mRenderModelDecodes; // null result if decoding failed
+		std::array<std::string, vr::k_unMaxTrackedDeviceCount> mPendingRenderModels; // model each device waits for, empty if none
+		std::array<RenderModelRef, vr::k_unMaxTrackedDeviceCount> mTrackedDeviceToRenderModel; // each holds a reference in mRenderModels
+
+		uint64_t					mFrameIndex;
+		FrameState					mFrameState;
+		FrameContext				mFrameContext;
+		PreStereoFn					mPreStereoFn;
+		std::vector<DrawList>		mViewDrawLists;
+		std::vector<std::future<void>>	mViewJobs;		// reused every frame
+
+		struct EyeSubmission {
+			ci::gl::Texture2dRef	texture;
+			ci::gl::FboRef			framebuffer;
+			vr::EColorSpace			colorSpace;
+			vr::VRTextureBounds_t	bounds;
+		};
+		EyeSubmission				mEyeSubmissions[2];
+		std::unique_ptr<JobPool>	mJobPool;
+		std::unique_ptr<UploadService>	mUploads;
+		std::unique_ptr<HapticEngine>	mHaptics;
+		FrameScheduler				mFrameScheduler;
+		PoseHistory					mPoseHistory;
+		double						mPosePrediction;	// seconds from the last vsync to the photons of the posed frame
+
+		EventBus					mEvents;
+		DevicePropertyCache			mDeviceProperties;
+		ChaperoneCache				mChaperone;
+		BoundsProximity				mBoundsProximity;
+		GlInstrument				mGl;
+		GLuint						mPrevReadFramebuffer, mPrevDrawFramebuffer;
+		std::pair<glm::ivec2, glm::ivec2>	mPrevViewport;
+		bool						mPrevMultisample;
+		std::vector<OverlayRef>		mOverlays;
+
+		std::vector<InitStage>		mInitStages;
+		size_t						mInitStage;
+		bool						mInitFailed;
+		std::function<void()>		mReadyFn;
+		std::promise<void>			mReadyPromise;
+		std::shared_future<void>	mReadyFuture;
+		std::shared_future<void>	mDeviceJob, mDistortionJob;
 	};
 
 	struct ScopedVive {
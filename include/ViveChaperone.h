@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "cinder/gl/gl.h"
+#include "cinder/Noncopyable.h"
+
+#include "openvr.h"
+
+namespace hmd {
+
+	//! Signed distances of every tracked device slot to the chaperone walls, on the floor plane.
+	struct BoundsProximity {
+		BoundsProximity();
+
+		std::array<float, vr::k_unMaxTrackedDeviceCount>	distance;	// meters to the nearest wall, negative outside the bounds
+		std::array<uint32_t, vr::k_unMaxTrackedDeviceCount>	wall;		// index of the nearest wall
+		std::array<bool, vr::k_unMaxTrackedDeviceCount>		valid;		// pose valid and bounds known
+		vr::TrackedDeviceIndex_t	nearestDevice;		// valid device closest to a wall, k_unTrackedDeviceIndexInvalid if none
+		float						nearestDistance;
+	};
+
+	//! Play area and collision bounds of the chaperone, read from the runtime once and refreshed on the
+	//! chaperone events, plus the per-frame proximity of the tracked devices to them. Bounds set with
+	//! setBounds() replace the runtime's, so sessions without a headset and tests get configurable walls.
+	class ChaperoneCache : ci::Noncopyable {
+	public:
+		ChaperoneCache();
+
+		void setChaperone( vr::IVRChaperone *chaperone, vr::IVRChaperoneSetup *chaperoneSetup ) { mChaperone = chaperone; mChaperoneSetup = chaperoneSetup; }
+
+		//! Re-reads the bounds from the runtime, unless they were overridden.
+		void refresh();
+		//! Refreshes on the chaperone data, universe and settings events.
+		void handleEvent( const vr::VREvent_t& event );
+
+		//! Replaces the runtime's bounds with the walls \a quads, in standing tracking space, and the play
+		//! area \a playAreaRect. Kept across refresh() until clearBoundsOverride().
+		void setBounds( const std::vector<vr::HmdQuad_t>& quads, const vr::HmdQuad_t& playAreaRect );
+		//! setBounds() with a centered \a sizeX by \a sizeZ meter rectangle of \a height meter walls.
+		void setRectangularBounds( float sizeX, float sizeZ, float height = 2.5f );
+		void clearBoundsOverride();
+		bool isBoundsOverridden() const { return mOverridden; }
+
+		//! True if the runtime reported calibrated bounds, or bounds were set.
+		bool								hasBounds() const { return ! mWallA.empty(); }
+		const glm::vec2&					getPlayAreaSize() const { return mPlayAreaSize; }
+		const std::array<glm::vec3, 4>&		getPlayAreaRect() const { return mPlayAreaRect; }
+		const std::vector<vr::HmdQuad_t>&	getCollisionBounds() const { return mQuads; }
+		//! Incremented whenever the bounds change.
+		uint32_t							getRevision() const { return mRevision; }
+
+		//! Distance of every valid pose in \a poses to the walls, four devices per SSE lane over all walls.
+		//! Poses are expected in standing tracking space, as WaitGetPoses returns them for scene apps.
+		void computeProximity( const std::array<vr::TrackedDevicePose_t, vr::k_unMaxTrackedDeviceCount>& poses, BoundsProximity *result ) const;
+
+		//! Two triangles per wall with inward normals, perimeter and height in meters as texture coordinates
+		//! for grid shaders. Rebuilt when the bounds change; nullptr without bounds. Render thread only.
+		ci::gl::VboMeshRef getBoundsMesh();
+
+	private:
+		//! Flattens \a quads into the wall segments the proximity query runs over.
+		void setWalls( const std::vector<vr::HmdQuad_t>& quads, const vr::HmdQuad_t& playAreaRect );
+
+		vr::IVRChaperone *			mChaperone;
+		vr::IVRChaperoneSetup *		mChaperoneSetup;
+		bool						mOverridden;
+		uint32_t					mRevision;
+
+		std::vector<vr::HmdQuad_t>	mQuads;
+		glm::vec2					mPlayAreaSize;
+		std::array<glm::vec3, 4>	mPlayAreaRect;
+
+		// wall segments on the floor plane, broadcast one at a time by the proximity kernel
+		std::vector<glm::vec2>		mWallA;
+		std::vector<glm::vec2>		mWallDelta;
+		std::vector<float>			mWallInvLengthSq;	// 0 for degenerate walls
+		std::vector<float>			mWallSlope;			// dx / dz for the crossing test, 0 for walls parallel to x
+		std::vector<glm::vec2>		mWallHeight;		// floor and top, for the mesh
+
+		ci::gl::VboMeshRef			mBoundsMesh;
+		uint32_t					mBoundsMeshRevision;
+	};
+
+}
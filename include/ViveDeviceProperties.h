@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "cinder/Noncopyable.h"
+
+#include "openvr.h"
+
+namespace hmd {
+
+	//! Snapshot of the commonly used properties of one tracked device. Strings point into the
+	//! cache's intern pool and stay valid for the lifetime of the cache.
+	struct TrackedDeviceProperties {
+		bool						isConnected;
+		vr::ETrackedDeviceClass		deviceClass;
+		vr::ETrackedControllerRole	role;
+
+		const std::string *			trackingSystemName;
+		const std::string *			serialNumber;
+		const std::string *			modelNumber;
+		const std::string *			manufacturerName;
+		const std::string *			renderModelName;
+
+		bool						isWireless;
+		bool						providesBatteryStatus;
+		bool						isCharging;
+		float						batteryPercentage;
+
+		// what each entry of VRControllerState_t::rAxis reports, k_eControllerAxis_None for non-controllers
+		std::array<vr::EVRControllerAxisType, vr::k_unControllerStateAxisCount>	axisTypes;
+	};
+
+	//! Per-device cache of tracked device properties. Refreshed from VR events so that per-frame
+	//! lookups never call into the runtime or allocate.
+	class DevicePropertyCache : ci::Noncopyable {
+	public:
+		DevicePropertyCache();
+
+		void setSystem( vr::IVRSystem *system ) { mSystem = system; }
+
+		//! Queries every property of \a device from the runtime.
+		void refresh( vr::TrackedDeviceIndex_t device );
+		//! Refreshes all connected devices and clears the others.
+		void refreshAll();
+		//! Re-reads the controller role of every connected controller.
+		void refreshRoles();
+		void invalidate( vr::TrackedDeviceIndex_t device );
+
+		//! Refreshes or invalidates the affected device for activation, deactivation, update and property events,
+		//! and the roles of all controllers for role events.
+		void handleEvent( const vr::VREvent_t& event );
+
+		const TrackedDeviceProperties&	get( vr::TrackedDeviceIndex_t device ) const { return mDevices[clampIndex( device )]; }
+		vr::ETrackedDeviceClass			getDeviceClass( vr::TrackedDeviceIndex_t device ) const { return get( device ).deviceClass; }
+		vr::ETrackedControllerRole		getControllerRole( vr::TrackedDeviceIndex_t device ) const { return get( device ).role; }
+		const std::string&				getSerialNumber( vr::TrackedDeviceIndex_t device ) const { return *get( device ).serialNumber; }
+		const std::string&				getModelNumber( vr::TrackedDeviceIndex_t device ) const { return *get( device ).modelNumber; }
+		const std::string&				getTrackingSystemName( vr::TrackedDeviceIndex_t device ) const { return *get( device ).trackingSystemName; }
+		const std::string&				getRenderModelName( vr::TrackedDeviceIndex_t device ) const { return *get( device ).renderModelName; }
+		//! Index into VRControllerState_t::rAxis of the first axis of \a type, \a fallback if the device has none.
+		uint32_t						findAxis( vr::TrackedDeviceIndex_t device, vr::EVRControllerAxisType type, uint32_t fallback ) const;
+
+		//! Number of runtime property queries issued since construction.
+		uint64_t						getNumRuntimeQueries() const { return mNumQueries; }
+
+	private:
+		// the last slot is an always-empty entry returned for out of range indices
+		static size_t		clampIndex( vr::TrackedDeviceIndex_t device ) { return device < vr::k_unMaxTrackedDeviceCount ? device : vr::k_unMaxTrackedDeviceCount; }
+		void				clear( TrackedDeviceProperties& props );
+		const std::string *	queryString( vr::TrackedDeviceIndex_t device, vr::ETrackedDeviceProperty prop );
+		const std::string *	intern( const char *str );
+
+		vr::IVRSystem *		mSystem;
+		std::array<TrackedDeviceProperties, vr::k_unMaxTrackedDeviceCount + 1>	mDevices;
+
+		std::unordered_set<std::string>	mStrings;
+		const std::string *				mEmptyString;
+		std::vector<char>				mScratch;
+		uint64_t						mNumQueries;
+	};
+
+}
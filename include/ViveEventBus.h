@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "cinder/Noncopyable.h"
+
+#include "openvr.h"
+
+namespace hmd {
+
+	//! Dispatches VREvent_t to handlers registered per event type. Dispatch walks a fixed
+	//! table and never allocates; only subscribe() grows storage. Handlers must not
+	//! subscribe or unsubscribe from within dispatch().
+	class EventBus : ci::Noncopyable {
+	public:
+		typedef std::function<void( const vr::VREvent_t& )> HandlerFn;
+		typedef uint32_t SubscriptionId;
+
+		//! Event types at or above this share a single overflow slot.
+		static const uint32_t	kMaxEventType = vr::VREvent_VendorSpecific_Reserved_End + 1;
+		static const uint32_t	kAnyEvent = kMaxEventType + 1;
+
+		EventBus();
+
+		//! Registers \a handler for \a eventType, or for every event when \a eventType is kAnyEvent.
+		SubscriptionId	subscribe( uint32_t eventType, const HandlerFn& handler );
+		void			unsubscribe( SubscriptionId id );
+
+		//! Counts \a event and invokes its handlers. Returns false when nobody handled it.
+		bool			dispatch( const vr::VREvent_t& event );
+
+		//! Unhandled events are logged on their first occurrence and every \a sampleEvery
+		//! occurrences after that, at most once per \a minIntervalSeconds. 0 disables logging (default).
+		void			setLogSampling( uint32_t sampleEvery, double minIntervalSeconds = 1.0 );
+
+		uint32_t		getEventCount( uint32_t eventType ) const { return mCounts[slot( eventType )]; }
+		uint64_t		getTotalEventCount() const { return mTotalCount; }
+		void			resetCounters();
+
+		//! Optional, used to print readable event names in the sampled log.
+		void			setSystem( vr::IVRSystem *system ) { mSystem = system; }
+
+	private:
+		struct Handler {
+			HandlerFn	fn;
+			int32_t		next;
+			uint32_t	slot;
+		};
+
+		static uint32_t	slot( uint32_t eventType ) { return eventType < kMaxEventType ? eventType : kMaxEventType; }
+		void			logUnhandled( const vr::VREvent_t& event, uint32_t count );
+
+		std::vector<Handler>	mHandlers;
+		std::vector<int32_t>	mFirstHandler;	// per slot, index into mHandlers or -1
+		std::vector<uint32_t>	mCounts;		// per slot
+		uint64_t				mTotalCount;
+
+		uint32_t				mLogSampleEvery;
+		double					mLogMinInterval;
+		std::chrono::steady_clock::time_point	mLastLogTime;
+		bool					mHasLogged;
+
+		vr::IVRSystem *			mSystem;
+	};
+
+}
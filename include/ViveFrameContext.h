@@ -0,0 +1,77 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+
+#include "cinder/gl/gl.h"
+#include "cinder/Noncopyable.h"
+
+namespace hmd {
+
+	struct FrameState;
+
+	//! One frustum enclosing both eyes. Its apex sits behind the head, far enough back that the
+	//! outer planes of both eye frusta are contained, so a single cull or pass covers either eye.
+	struct SharedFrustum {
+		glm::mat4	view;			// world to shared camera
+		glm::mat4	projection;
+		glm::vec4	planes[6];		// world space, normals pointing inwards
+		float		pullback;		// distance from the head to the apex, in meters
+
+		//! True if the sphere is at least partially inside the frustum.
+		bool intersectsSphere( const glm::vec3& center, float radius ) const;
+	};
+
+	//! Eye-independent state of the current frame, handed to the pre-stereo callback and readable from
+	//! the eye callbacks. Named passes rendered through it keep their FBO between frames and run at
+	//! most once per frame, however many views read them.
+	class FrameContext : ci::Noncopyable {
+	public:
+		typedef std::function<void( const FrameContext& )> RenderPassFn;
+
+		FrameContext();
+
+		const FrameState&		getFrameState() const { return *mFrameState; }
+		uint64_t				getFrameIndex() const { return mFrameIndex; }
+		const SharedFrustum&	getSharedFrustum() const { return mSharedFrustum; }
+
+		//! Renders \a renderFn into the FBO of pass \a name, unless the pass already ran within its last
+		//! \a updateDivisor frames. The FBO is created with \a format on first use and recreated when \a size
+		//! changes. The framebuffer, viewport and matrices are restored afterwards. Render thread only.
+		ci::gl::FboRef	renderPass( const std::string& name, const glm::ivec2& size, const ci::gl::Fbo::Format& format, const RenderPassFn& renderFn, uint32_t updateDivisor = 1 );
+		//! Returns the FBO of pass \a name, or nullptr if it was never rendered.
+		ci::gl::FboRef	getPass( const std::string& name ) const;
+		//! True if pass \a name was rendered, not reused, this frame.
+		bool			wasPassRendered( const std::string& name ) const;
+		void			releasePass( const std::string& name );
+		void			releasePasses();
+
+		//! Passes rendered and reused this frame.
+		uint32_t		getNumPassesRendered() const { return mNumRendered; }
+		uint32_t		getNumPassesReused() const { return mNumReused; }
+
+	private:
+		friend class HtcVive;
+		void beginFrame( const FrameState& frameState, const SharedFrustum& sharedFrustum );
+
+		struct Pass {
+			ci::gl::FboRef	fbo;
+			uint64_t		lastFrame;
+		};
+
+		const FrameState*				mFrameState;
+		uint64_t						mFrameIndex;
+		SharedFrustum					mSharedFrustum;
+		std::map<std::string, Pass>		mPasses;
+		uint32_t						mNumRendered;
+		uint32_t						mNumReused;
+	};
+
+	//! Computes the frustum enclosing two eyes from their projections and head-to-eye transforms.
+	SharedFrustum makeSharedFrustum( const glm::mat4& headView, const glm::mat4& leftProjection, const glm::mat4& leftHeadToEye, const glm::mat4& rightProjection, const glm::mat4& rightHeadToEye, float nearClip, float farClip );
+	//! As makeSharedFrustum(), with the apex between the eyes instead of behind them. Only encloses both eyes
+	//! where their offset is negligible, a few meters out; the monoscopic far field is rendered from it.
+	SharedFrustum makeCenterEyeFrustum( const glm::mat4& headView, const glm::mat4& leftProjection, const glm::mat4& leftHeadToEye, const glm::mat4& rightProjection, const glm::mat4& rightHeadToEye, float nearClip, float farClip );
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "cinder/Noncopyable.h"
+
+#include "openvr.h"
+
+namespace hmd {
+
+	//! Tracked device poses returned by one WaitGetPoses call.
+	struct PoseFrame {
+		uint64_t												index;
+		std::chrono::steady_clock::time_point					timestamp;	// when WaitGetPoses returned
+		float													secondsSinceVsync;	// at timestamp
+		std::array<vr::TrackedDevicePose_t, vr::k_unMaxTrackedDeviceCount>	poses;
+	};
+
+	//! Calls WaitGetPoses on a dedicated thread so the compositor wait overlaps with the app's
+	//! simulation instead of stalling the render thread. Each submitted frame grants the thread one
+	//! wait; the resulting poses are handed over through a bounded queue that drops the oldest
+	//! entry when the render thread falls behind.
+	class FrameScheduler : ci::Noncopyable {
+	public:
+		explicit FrameScheduler( size_t capacity = 2 );
+		~FrameScheduler();
+
+		void	start();
+		//! May block until the pending WaitGetPoses returns, at most one compositor frame.
+		void	stop();
+		bool	isRunning() const { return mThread.joinable(); }
+
+		//! Waits up to \a timeout for the next pose frame. Returns false on timeout or when stopped.
+		bool	pop( PoseFrame& frame, std::chrono::milliseconds timeout = std::chrono::milliseconds( 100 ) );
+		//! Called after Submit(); lets the thread wait for the compositor's next frame.
+		void	frameSubmitted();
+
+		uint64_t	getNumFrames() const;
+		//! Pose frames discarded because the queue was full.
+		uint64_t	getNumDropped() const;
+		//! Time the last WaitGetPoses call blocked for.
+		double		getLastWaitSeconds() const;
+
+	private:
+		void threadLoop();
+
+		size_t					mCapacity;
+		mutable std::mutex		mMutex;
+		std::condition_variable	mWaitAllowed;
+		std::condition_variable	mFrameReady;
+		std::deque<PoseFrame>	mFrames;
+		uint32_t				mGrants;		// waits allowed by submitted frames
+		bool					mStopping;
+		uint64_t				mNumFrames;
+		uint64_t				mNumDropped;
+		double					mLastWaitSeconds;
+		std::thread				mThread;
+	};
+
+}
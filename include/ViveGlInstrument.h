@@ -0,0 +1,149 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Vao.h"
+
+#include "openvr.h"
+
+// Direct state access entry points are only referenced when the GL headers expose them.
+#if defined( GL_VERSION_4_5 ) || defined( GL_ARB_direct_state_access )
+	#define CINDER_VIVE_GL_DSA 1
+#else
+	#define CINDER_VIVE_GL_DSA 0
+#endif
+
+// Compute shaders and image load/store, likewise only referenced when exposed by the headers.
+#if defined( GL_VERSION_4_3 )
+	#define CINDER_VIVE_GL_COMPUTE 1
+#else
+	#define CINDER_VIVE_GL_COMPUTE 0
+#endif
+
+namespace hmd {
+
+	struct GlCallStats {
+		GlCallStats() { reset(); }
+		void reset();
+		GlCallStats& operator+=( const GlCallStats& rhs );
+
+		uint32_t	framebufferBinds;
+		uint32_t	blits;
+		uint32_t	drawCalls;
+		uint32_t	dispatches;
+		uint32_t	programBinds;
+		uint32_t	vertexArrayBinds;
+		uint32_t	textureBinds;
+		uint32_t	stateChanges;		// enable/disable and viewport
+		uint32_t	redundantSkipped;	// binds and state changes dropped by the state cache
+		uint32_t	bufferUploads;
+		uint32_t	textureUploads;
+		uint32_t	submits;
+		uint64_t	bufferBytes;
+		uint64_t	textureBytes;
+		uint64_t	maskedPixels;		// pixels left unshaded by the radial density mask
+	};
+
+	std::ostream& operator<<( std::ostream& os, const GlCallStats& stats );
+
+	//! Thin layer around the GL and compositor calls HtcVive issues. State changes go through
+	//! Cinder's context cache so redundant ones are dropped and Cinder stays coherent. Every
+	//! call is counted per frame and, with the null backend, recorded without being executed.
+	//! The null backend still needs a live context: resources, the distortion lookup's framebuffer
+	//! included, are created for real, and the app's callbacks and FrameContext passes render for real.
+	class GlInstrument : ci::Noncopyable {
+	public:
+		enum Backend {
+			BACKEND_GL,		//!< Pass-through: calls are counted and executed.
+			BACKEND_NULL	//!< Calls are counted against a shadow state but nothing reaches the driver or the compositor.
+		};
+
+		GlInstrument();
+
+		//! Switch only after HtcVive construction; GL resources are always created for real.
+		void		setBackend( Backend backend ) { mBackend = backend; }
+		Backend		getBackend() const { return mBackend; }
+		bool		isNull() const { return mBackend == BACKEND_NULL; }
+
+		//! Enables the direct state access path when the context is GL 4.5 or exposes ARB_direct_state_access.
+		void		detectCapabilities();
+		bool		hasDirectStateAccess() const { return mDirectStateAccess; }
+		//! Allows forcing the bind-to-edit path, e.g. to compare call counts.
+		void		setDirectStateAccessEnabled( bool enable ) { mDirectStateAccess = enable && mDirectStateAccessSupported; }
+		//! True for GL 4.3 contexts, or with ARB_compute_shader and ARB_shader_image_load_store.
+		bool		hasCompute() const { return mComputeSupported; }
+
+		//! Closes the current frame's counters and starts new ones.
+		void				beginFrame();
+		//! Counters of the last completed frame.
+		const GlCallStats&	getFrameStats() const { return mLastFrame; }
+		//! Counters of the frame in progress.
+		const GlCallStats&	getCurrentStats() const { return mCurrent; }
+		//! Counters accumulated over all completed frames.
+		const GlCallStats&	getTotalStats() const { return mTotal; }
+		uint64_t			getNumFrames() const { return mNumFrames; }
+
+		GLuint						getFramebuffer( GLenum target );
+		bool						isEnabled( GLenum cap );
+		std::pair<ci::ivec2, ci::ivec2>	getViewport();
+
+		void bindFramebuffer( GLenum target, GLuint framebuffer );
+		//! Copies between two framebuffers, with glBlitNamedFramebuffer when available so no binding changes.
+		void blitFramebuffer( GLuint readFramebuffer, GLuint drawFramebuffer, GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter );
+		void drawElements( GLenum mode, GLsizei count, GLenum type, const void *indices );
+		void drawArrays( GLenum mode, GLint first, GLsizei count );
+		void dispatchCompute( GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ );
+		void bindGlslProg( const ci::gl::GlslProgRef& program );
+		//! Binds a raw program handle. Cinder's cached program is reset first so its next bind isn't skipped.
+		//! Skipped if the same handle is still bound from the last call.
+		void useProgram( GLuint program );
+		//! Cinder can't see raw handles, and code binding through it and then back to no program leaves the
+		//! raw handle looking current. Call before and after handing control to such code.
+		void forgetRawProgram() { mRawProgram = 0; mNullState.rawProgram = 0; }
+		void bindVao( const ci::gl::VaoRef& vao );
+		void bindTexture( const ci::gl::TextureBaseRef& texture, uint8_t textureUnit = 0 );
+		void bindTexture( GLenum target, GLuint texture, uint8_t textureUnit = 0 );
+		void enable( GLenum cap, bool value = true );
+		void disable( GLenum cap ) { enable( cap, false ); }
+		//! Sets every color channel's write mask until popColorMask() restores Cinder's previous one.
+		void pushColorMask( bool write );
+		void popColorMask();
+		void viewport( GLint x, GLint y, GLsizei width, GLsizei height );
+		vr::EVRCompositorError submit( vr::Hmd_Eye eye, const vr::Texture_t& texture, const vr::VRTextureBounds_t *bounds = nullptr );
+
+		//! For uploads issued through Cinder objects (Vbo, Texture2d) rather than raw GL.
+		void recordBufferUpload( size_t bytes );
+		void recordTextureUpload( size_t bytes );
+		//! Pixels the radial density mask kept from being shaded; computed on the CPU, so also counted with the null backend.
+		void recordMaskedPixels( uint64_t pixels );
+
+	private:
+		// mirrors the subset of Cinder's context state tracked while the null backend is active
+		struct NullState {
+			NullState() : readFramebuffer( 0 ), drawFramebuffer( 0 ), program( nullptr ), rawProgram( 0 ), vao( nullptr ) {}
+
+			GLuint							readFramebuffer, drawFramebuffer;
+			const void *					program;
+			GLuint							rawProgram;
+			const void *					vao;
+			std::pair<ci::ivec2, ci::ivec2>	viewport;
+			std::map<GLenum, bool>			caps;
+			std::map<uint32_t, GLuint>		textures;	// keyed by unit
+		};
+
+		Backend		mBackend;
+		bool		mDirectStateAccessSupported;
+		bool		mDirectStateAccess;
+		bool		mComputeSupported;
+		NullState	mNullState;
+		GLuint		mRawProgram;	// last handle passed to useProgram(), 0 once Cinder may have rebound
+
+		GlCallStats	mCurrent;
+		GlCallStats	mLastFrame;
+		GlCallStats	mTotal;
+		uint64_t	mNumFrames;
+	};
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <initializer_list>
+#include <mutex>
+#include <thread>
+
+#include "cinder/Noncopyable.h"
+
+#include "openvr.h"
+
+namespace hmd {
+
+	//! Vibration pattern played by HapticEngine. Intensity follows a piecewise linear envelope
+	//! spread evenly over the duration; a single point gives a constant intensity.
+	class HapticWaveform {
+	public:
+		static const size_t kMaxEnvelopePoints = 16;
+
+		HapticWaveform();
+
+		HapticWaveform& duration( float seconds ) { mDuration = seconds; return *this; }
+		//! Constant intensity in [0, 1].
+		HapticWaveform& intensity( float intensity );
+		//! Up to kMaxEnvelopePoints intensities in [0, 1]; extra points are ignored.
+		HapticWaveform& envelope( std::initializer_list<float> points );
+		//! Number of additional plays after the first.
+		HapticWaveform& repeat( uint32_t count ) { mRepeatCount = count; return *this; }
+		//! A playing waveform is only pre-empted by one of equal or higher priority.
+		HapticWaveform& priority( int priority ) { mPriority = priority; return *this; }
+		HapticWaveform& axis( uint32_t axis ) { mAxis = axis; return *this; }
+
+		float		getDuration() const { return mDuration; }
+		uint32_t	getRepeatCount() const { return mRepeatCount; }
+		int			getPriority() const { return mPriority; }
+		uint32_t	getAxis() const { return mAxis; }
+		//! Envelope value at \a t seconds into one play.
+		float		getIntensity( float t ) const;
+
+	private:
+		std::array<float, kMaxEnvelopePoints>	mEnvelope;
+		size_t		mNumPoints;
+		float		mDuration;
+		uint32_t	mRepeatCount;
+		int			mPriority;
+		uint32_t	mAxis;
+	};
+
+	//! Plays haptic waveforms from a dedicated timing thread, independent of the frame rate. Each
+	//! controller is a channel playing one waveform at a time. Intensity is rendered by varying the
+	//! width of the pulse emitted every period, as the runtime accepts one pulse per ~5 ms per device.
+	//! Commands travel through a lock-free single producer queue, so play() and stop() must be called
+	//! from one thread (usually the app thread). They only take a lock to wake the thread, which sleeps
+	//! while nothing plays. The system timer resolution is raised to 1 ms for the engine's lifetime.
+	class HapticEngine : ci::Noncopyable {
+	public:
+		static const size_t		kQueueCapacity = 64;
+		static const uint16_t	kMaxPulseMicroseconds = 3999;
+
+		explicit HapticEngine( vr::IVRSystem *system, std::chrono::microseconds period = std::chrono::microseconds( 5000 ) );
+		~HapticEngine();
+
+		//! Returns false if the command queue is full.
+		bool play( vr::TrackedDeviceIndex_t device, const HapticWaveform& waveform );
+		bool stop( vr::TrackedDeviceIndex_t device );
+		bool stopAll();
+
+		//! Pulses sent to the runtime since construction.
+		uint64_t	getNumPulses() const { return mNumPulses; }
+		//! Commands lost because the queue was full.
+		uint32_t	getNumDropped() const { return mNumDropped; }
+		//! Waveforms cut short by a higher or equal priority one.
+		uint32_t	getNumPreempted() const { return mNumPreempted; }
+		//! Waveforms refused because a higher priority one was playing.
+		uint32_t	getNumRejected() const { return mNumRejected; }
+
+	private:
+		enum CommandType { COMMAND_PLAY, COMMAND_STOP, COMMAND_STOP_ALL };
+
+		struct Command {
+			CommandType					type;
+			vr::TrackedDeviceIndex_t	device;
+			HapticWaveform				waveform;
+		};
+
+		struct Channel {
+			Channel() : active( false ), remainingPlays( 0 ) {}
+
+			bool									active;
+			HapticWaveform							waveform;
+			std::chrono::steady_clock::time_point	start;
+			uint32_t								remainingPlays;
+		};
+
+		bool push( const Command& command );
+		void threadLoop();
+		//! Blocks until a command is queued or the engine stops.
+		void waitForCommands();
+		void apply( const Command& command, std::chrono::steady_clock::time_point now );
+		//! Pulses every active channel. Returns false if none is left playing.
+		bool tick( std::chrono::steady_clock::time_point now );
+
+		vr::IVRSystem *				mSystem;
+		std::chrono::microseconds	mPeriod;
+
+		// single producer, single consumer ring; each index is only written by one side
+		std::array<Command, kQueueCapacity>	mQueue;
+		std::atomic<size_t>					mQueueHead;	// next slot to read, written by the timing thread
+		std::atomic<size_t>					mQueueTail;	// next slot to write, written by the producer
+
+		std::array<Channel, vr::k_unMaxTrackedDeviceCount>	mChannels;	// only touched by the timing thread
+
+		std::atomic<bool>		mRunning;
+		std::atomic<bool>		mIdle;		// set by the timing thread before it waits for commands
+		std::mutex				mWakeMutex;
+		std::condition_variable	mWakeCondition;
+		std::atomic<uint64_t>	mNumPulses;
+		std::atomic<uint32_t>	mNumDropped;
+		std::atomic<uint32_t>	mNumPreempted;
+		std::atomic<uint32_t>	mNumRejected;
+		std::thread				mThread;
+	};
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "cinder/Noncopyable.h"
+
+namespace hmd {
+
+	//! Fixed set of worker threads draining a FIFO of jobs. Jobs must not issue GL calls.
+	class JobPool : ci::Noncopyable {
+	public:
+		//! \a numThreads of 0 uses one thread less than the hardware concurrency (at least one).
+		explicit JobPool( size_t numThreads = 0 );
+		~JobPool();
+
+		template<typename Fn>
+		std::future<typename std::result_of<Fn()>::type> enqueue( Fn fn )
+		{
+			typedef typename std::result_of<Fn()>::type ResultT;
+			auto task = std::make_shared<std::packaged_task<ResultT()>>( std::move( fn ) );
+			auto result = task->get_future();
+			pushJob( [task] { (*task)(); } );
+			return result;
+		}
+
+		size_t getNumThreads() const { return mThreads.size(); }
+
+	private:
+		void pushJob( std::function<void()> job );
+		void workerLoop();
+
+		std::vector<std::thread>			mThreads;
+		std::deque<std::function<void()>>	mJobs;
+		std::mutex							mMutex;
+		std::condition_variable				mCondition;
+		bool								mStopping;
+	};
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include "cinder/gl/gl.h"
+
+#include "openvr.h"
+
+namespace hmd {
+
+	//! 16 byte vertex: snorm16 position, snorm 10:10:10:2 normal and unorm16 texture coordinate.
+	struct QuantizedVertex {
+		int16_t		position[4];	// w unused, keeps the normal 4 byte aligned
+		uint32_t	normal;			// GL_INT_2_10_10_10_REV
+		uint16_t	texCoord[2];
+	};
+
+	//! Render model geometry ordered for the post-transform cache and vertex fetch, with quantized attributes.
+	//! Positions decode as position * positionScale + positionOffset, texture coordinates likewise.
+	struct QuantizedMesh {
+		std::vector<QuantizedVertex>	vertices;
+		std::vector<uint16_t>			indices;
+		glm::vec3						positionScale;
+		glm::vec3						positionOffset;
+		glm::vec2						texCoordScale;
+		glm::vec2						texCoordOffset;
+		float							acmrBefore;		// average cache miss ratio of the runtime's index order
+		float							acmrAfter;
+	};
+
+	//! Reorders triangles in place for a post-transform vertex cache (Forsyth's linear-speed algorithm).
+	void optimizeVertexCache( uint16_t* indices, size_t indexCount, size_t vertexCount );
+	//! Renumbers vertices in order of first use and rewrites \a indices. Returns the old index of each new vertex.
+	std::vector<uint16_t> optimizeVertexFetch( uint16_t* indices, size_t indexCount, size_t vertexCount );
+	//! Vertex shader invocations per triangle with a FIFO cache of \a cacheSize entries; 0.5 is ideal, 3 is no reuse.
+	float computeAcmr( const uint16_t* indices, size_t indexCount, size_t cacheSize = 16 );
+
+	//! Runs both optimizations over \a model and quantizes its vertices. CPU only, safe on worker threads.
+	QuantizedMesh optimizeRenderModel( const vr::RenderModel_t& model );
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Fbo.h"
+
+#include "openvr.h"
+
+namespace hmd {
+
+	typedef std::shared_ptr<class Overlay> OverlayRef;
+
+	//! Compositor overlay backed by its own FBO. The FBO is only re-rendered and
+	//! re-submitted after markDirty(), so UI drawn here costs nothing in the eye passes.
+	class Overlay : ci::Noncopyable {
+	public:
+		typedef std::function<void( const glm::ivec2& size )> RenderFn;
+
+		~Overlay();
+
+		void setRenderFn( const RenderFn& renderFn ) { mRenderFn = renderFn; mDirty = true; }
+		void markDirty() { mDirty = true; }
+		bool isDirty() const { return mDirty; }
+
+		void setWidthInMeters( float width );
+		void setAlpha( float alpha );
+		void setSortOrder( uint32_t order );
+
+		//! Places the overlay relative to the HMD.
+		void setTransformHmdRelative( const glm::mat4& transform ) { setTransformDeviceRelative( vr::k_unTrackedDeviceIndex_Hmd, transform ); }
+		//! Places the overlay relative to a tracked device, e.g. a controller.
+		void setTransformDeviceRelative( vr::TrackedDeviceIndex_t device, const glm::mat4& transform );
+		//! Places the overlay in the standing tracking space.
+		void setTransformAbsolute( const glm::mat4& transform );
+
+		void show();
+		void hide();
+		bool isVisible() const { return mVisible; }
+
+		const ci::gl::FboRef&	getFbo() const { return mFbo; }
+		vr::VROverlayHandle_t	getHandle() const { return mHandle; }
+
+		//! Renders into the FBO and hands it to the compositor if dirty. Called by HtcVive::unbind().
+		bool update();
+		//! Destroys the compositor overlay. Called by HtcVive before the runtime shuts down.
+		void release();
+
+	private:
+		Overlay( const std::string& key, const std::string& name, const glm::ivec2& size );
+		friend class HtcVive;
+
+		bool checkError( int error, const char *call ) const;
+
+		vr::VROverlayHandle_t	mHandle;
+		std::string				mKey;
+		ci::gl::FboRef			mFbo;
+		RenderFn				mRenderFn;
+		bool					mDirty;
+		bool					mVisible;
+	};
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "cinder/Noncopyable.h"
+#include "glm/gtc/quaternion.hpp"
+
+#include "openvr.h"
+
+namespace hmd {
+
+	//! Pose of one device at one point in time, in tracking space.
+	struct PoseSample {
+		double		time;				// seconds on the PoseHistory::now() clock
+		glm::vec3	position;
+		glm::quat	orientation;
+		glm::vec3	velocity;			// meters per second
+		glm::vec3	angularVelocity;	// radians per second, tracking space axis
+
+		glm::mat4	toMat4() const;
+	};
+
+	//! Fixed-capacity ring of pose samples per tracked device, covering a time window of recent frames.
+	//! Samples are pushed once per frame from the render thread and can be queried from any thread;
+	//! neither path allocates. Invalid poses are not recorded, so queries interpolate across short
+	//! tracking gaps.
+	class PoseHistory : ci::Noncopyable {
+	public:
+		//! Sized for \a windowSeconds at \a sampleRate samples per second.
+		explicit PoseHistory( double windowSeconds = 1.5, double sampleRate = 90.0 );
+
+		//! Reallocates and clears the history. Not safe to call concurrently with queries.
+		void		setWindow( double windowSeconds, double sampleRate = 90.0 );
+		double		getWindow() const { return mWindow; }
+		size_t		getCapacity() const { return mCapacity; }
+		void		clear();
+
+		//! Records every valid pose of one WaitGetPoses call, predicted for display at \a time.
+		void		push( double time, const vr::TrackedDevicePose_t* poses, uint32_t count );
+
+		//! Pose of \a device at \a time, interpolated between the neighboring samples (slerp for the
+		//! orientation). Times after the newest sample are extrapolated from its velocities by at most
+		//! \a maxLookAhead seconds. Returns false when the device has no samples or \a time is older than the window.
+		bool		sample( vr::TrackedDeviceIndex_t device, double time, PoseSample* result, double maxLookAhead = 0.05 ) const;
+		bool		getNewest( vr::TrackedDeviceIndex_t device, PoseSample* result ) const;
+		//! Time span covered by the samples of \a device; both are 0 when it has none.
+		void		getTimeRange( vr::TrackedDeviceIndex_t device, double* oldest, double* newest ) const;
+
+		//! Current time on the clock used for sample times.
+		static double now() { return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count(); }
+
+	private:
+		struct Ring {
+			size_t	start;
+			size_t	count;
+		};
+
+		const PoseSample& at( vr::TrackedDeviceIndex_t device, size_t i ) const { return mSamples[device * mCapacity + ( mRings[device].start + i ) % mCapacity]; }
+
+		mutable std::mutex			mMutex;
+		double						mWindow;
+		size_t						mCapacity;
+		std::vector<PoseSample>		mSamples;	// mCapacity per device
+		Ring						mRings[vr::k_unMaxTrackedDeviceCount];
+	};
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "cinder/gl/gl.h"
+#include "cinder/Filesystem.h"
+
+namespace hmd {
+
+	//! Links GLSL programs from linked binaries persisted with glGetProgramBinary(), falling back to
+	//! compiling the sources. Entries are keyed by a hash of the driver strings and the sources, so a
+	//! driver update or a shader edit simply misses. An empty directory disables persistence.
+	class ProgramBinaryCache : ci::Noncopyable {
+	public:
+		ProgramBinaryCache();
+
+		void					setDirectory( const ci::fs::path& directory ) { mDirectory = directory; }
+		const ci::fs::path&		getDirectory() const { return mDirectory; }
+
+		//! Returns a linked program handle owned by the caller, or 0 if compiling or linking failed.
+		GLuint		createProgram( const std::string& vertex, const std::string& fragment );
+		GLuint		createComputeProgram( const std::string& compute );
+
+		uint32_t	getNumHits() const { return mNumHits; }
+		uint32_t	getNumMisses() const { return mNumMisses; }
+
+	private:
+		typedef std::vector<std::pair<GLenum, const std::string *>> Stages;
+
+		GLuint			build( const Stages& stages );
+		uint64_t		hashSources( const Stages& stages ) const;
+		ci::fs::path	getEntryPath( uint64_t key ) const;
+		GLuint			loadBinary( uint64_t key );
+		void			storeBinary( uint64_t key, GLuint program );
+
+		ci::fs::path	mDirectory;
+		bool			mSupported;
+		bool			mQueriedSupport;
+		std::string		mDriver;
+		uint32_t		mNumHits;
+		uint32_t		mNumMisses;
+	};
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "cinder/Noncopyable.h"
+
+namespace hmd {
+
+	typedef std::shared_ptr<class RenderModel> RenderModelRef;
+
+	struct RenderModelStats {
+		RenderModelStats();
+
+		uint32_t	numModels;		// known names, resident or evicted
+		uint32_t	numResident;
+		uint32_t	numReferenced;
+		uint64_t	residentBytes;
+		uint64_t	referencedBytes;
+		uint32_t	loads;			// first loads
+		uint32_t	reloads;		// loads of a previously evicted model
+		uint32_t	hits;			// acquires served by a resident model
+		uint32_t	evictions;
+	};
+
+	//! Render models indexed by name and reference counted by their users, usually one per tracked
+	//! device. Unreferenced models stay resident until the VRAM budget is exceeded, then their
+	//! buffers and textures are dropped least recently released first. Acquiring an evicted model
+	//! reloads it. Referenced models are never evicted, so the budget can be exceeded by them alone.
+	//! The LoadFn runs on the caller's thread; callers that can't block check isResident() first.
+	class RenderModelManager : ci::Noncopyable {
+	public:
+		typedef std::function<RenderModelRef( const std::string& name )> LoadFn;
+
+		explicit RenderModelManager( const LoadFn& loadFn, uint64_t budgetBytes = 64 * 1024 * 1024 );
+
+		//! Returns the model, loading or reloading it if needed, and adds a reference. nullptr if loading failed.
+		RenderModelRef	acquire( const std::string& name );
+		//! Drops a reference taken by acquire().
+		void			release( const std::string& name );
+		//! True if acquire() would return \a name without loading it.
+		bool			isResident( const std::string& name ) const;
+
+		void			setBudget( uint64_t bytes );
+		uint64_t		getBudget() const { return mBudget; }
+		//! Evicts every unreferenced model regardless of the budget.
+		void			evictUnreferenced();
+		//! Forgets every model. Outstanding references become invalid.
+		void			clear();
+
+		const RenderModelStats&	getStats() const { return mStats; }
+
+	private:
+		struct Entry {
+			Entry() : bytes( 0 ), refCount( 0 ) {}
+
+			RenderModelRef						model;
+			uint64_t							bytes;
+			uint32_t							refCount;
+			std::list<Entry *>::iterator		lruIt;	// valid while resident and unreferenced
+		};
+
+		void	evict( Entry& entry );
+		void	enforceBudget();
+
+		LoadFn										mLoadFn;
+		uint64_t									mBudget;
+		std::unordered_map<std::string, Entry>		mEntries;
+		std::list<Entry *>							mLru;	// least recently released first
+		RenderModelStats							mStats;
+	};
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cinder/gl/gl.h"
+#include "cinder/ImageIo.h"
+#include "cinder/Noncopyable.h"
+#include "cinder/Surface.h"
+
+namespace hmd {
+
+	struct UploadStats {
+		UploadStats();
+
+		uint32_t	textures;
+		uint32_t	buffers;
+		uint32_t	batches;		// fences waited on, one per drained queue
+		uint64_t	bytes;
+		size_t		stagingBytes;	// current size of the reused pixel staging buffer
+	};
+
+	//! Uploads textures and buffers on a worker thread owning a GL context shared with the render
+	//! context. Jobs queued while a batch uploads form the next batch; each batch ends with a fence the
+	//! worker waits on before resolving its futures, so the render thread only receives resources whose
+	//! uploads have completed and never stalls binding them. Submitting is thread safe.
+	class UploadService : ci::Noncopyable {
+	public:
+		//! Construct on the render thread, with the context to share with current.
+		UploadService();
+		~UploadService();
+
+		//! Copies \a surface and uploads it through the staging buffer, generating mipmaps if \a format asks for
+		//! them. Rows are uploaded as stored, first row at t = 0, as with Format::loadTopDown().
+		std::shared_future<ci::gl::Texture2dRef>	uploadTexture( const ci::Surface8u& surface, const ci::gl::Texture2d::Format& format = ci::gl::Texture2d::Format() );
+		//! As above, decoding \a source on the worker as well.
+		std::shared_future<ci::gl::Texture2dRef>	uploadTexture( const ci::ImageSourceRef& source, const ci::gl::Texture2d::Format& format = ci::gl::Texture2d::Format() );
+		std::shared_future<ci::gl::VboRef>			uploadBuffer( GLenum target, std::vector<uint8_t> data, GLenum usage = GL_STATIC_DRAW );
+
+		template<typename T>
+		std::shared_future<ci::gl::VboRef> uploadBuffer( GLenum target, const std::vector<T>& data, GLenum usage = GL_STATIC_DRAW )
+		{
+			const uint8_t *bytes = reinterpret_cast<const uint8_t *>( data.data() );
+			return uploadBuffer( target, std::vector<uint8_t>( bytes, bytes + data.size() * sizeof( T ) ), usage );
+		}
+
+		//! Jobs queued or uploading.
+		size_t		getNumPending() const;
+		UploadStats	getStats() const;
+
+	private:
+		struct Job {
+			std::function<void()>	upload;		// worker thread, issues the GL calls
+			std::function<void()>	complete;	// after the batch fence, resolves the future
+			std::function<void( std::exception_ptr )>	fail;
+		};
+
+		template<typename T>
+		std::shared_future<T> enqueue( const std::function<T()>& upload )
+		{
+			auto promise = std::make_shared<std::promise<T>>();
+			auto result = std::make_shared<T>();
+			Job job;
+			job.upload = [upload, result] { *result = upload(); };
+			job.complete = [promise, result] { promise->set_value( *result ); };
+			job.fail = [promise]( std::exception_ptr error ) { promise->set_exception( error ); };
+			pushJob( std::move( job ) );
+			return promise->get_future().share();
+		}
+
+		void					pushJob( Job job );
+		void					workerLoop( ci::gl::ContextRef context );
+		ci::gl::Texture2dRef	createTexture( const ci::Surface8u& surface, const ci::gl::Texture2d::Format& format );
+		//! Returns the offset of \a bytes in the bound staging buffer, growing it if the batch doesn't fit.
+		size_t					allocateStaging( size_t bytes );
+
+		std::thread				mThread;
+		std::deque<Job>			mJobs;
+		size_t					mNumUploading;
+		mutable std::mutex		mMutex;
+		std::condition_variable	mCondition;
+		bool					mStopping;
+
+		// worker thread only
+		GLuint					mStagingBuffer;
+		size_t					mStagingSize;
+		size_t					mStagingOffset;
+		UploadStats				mStats;		// guarded by mMutex
+	};
+
+}
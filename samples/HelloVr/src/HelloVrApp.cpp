@@ -19,10 +19,12 @@ public:
 
 	void finishDraw();
 	void renderScene( vr::Hmd_Eye eye );
+	void drawCubes();
 private:
 	hmd::HtcViveRef		mVive;
 
 	gl::Texture2dRef	mCubeTexture;
+	std::shared_future<gl::Texture2dRef>	mCubeTextureUpload;
 	gl::BatchRef		mCubeBatch;
 	gl::GlslProgRef		mCubeGlsl;
 };
@@ -33,7 +35,8 @@ HelloVrApp::HelloVrApp()
 	rgl->setFinishDrawFn( std::bind( &HelloVrApp::finishDraw, this ) );
 
 	try {
-		mVive = hmd::HtcVive::create();
+		// the remaining setup runs in the background while the scene assets below load
+		mVive = hmd::HtcVive::create( hmd::HtcVive::Options().asynchronous().backgroundUploads().programCacheDirectory( getAppPath() / "programcache" ) );
 	}
 	catch( const hmd::ViveExeption& exc ) {
 		CI_LOG_E( exc.what() );
@@ -45,7 +48,11 @@ HelloVrApp::HelloVrApp()
 	fmt.setMaxAnisotropy( fLargest );
 	fmt.mipmap( true );
 	fmt.loadTopDown();
-	mCubeTexture = gl::Texture2d::create( loadImage( loadAsset( "cube_texture.png" ) ), fmt );
+	// decoded and uploaded on the shared context, the cubes appear once it resolves
+	if( mVive )
+		mCubeTextureUpload = mVive->getUploadService().uploadTexture( loadImage( loadAsset( "cube_texture.png" ) ), fmt );
+	else
+		mCubeTexture = gl::Texture2d::create( loadImage( loadAsset( "cube_texture.png" ) ), fmt );
 	auto cubeMesh = gl::VboMesh::create( geom::Cube().size( vec3( 0.5 ) ) );
 
 	mCubeGlsl = gl::GlslProg::create( gl::GlslProg::Format().vertex( loadAsset( "cube.vert" ) ).fragment( loadAsset( "cube.frag" ) ) );
@@ -72,6 +79,14 @@ HelloVrApp::HelloVrApp()
 void HelloVrApp::renderScene( vr::Hmd_Eye eye )
 {
 	gl::clear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	drawCubes();
+}
+
+void HelloVrApp::drawCubes()
+{
+	if( ! mCubeTexture )
+		return;
+
 	gl::ScopedDepth depth{ true };
 	gl::ScopedTextureBind tex0{ mCubeTexture, 0 };
 	mCubeBatch->drawInstanced( 21 * 21 * 21 );
@@ -82,14 +97,25 @@ void HelloVrApp::update()
 {	
 	if( mVive )
 		mVive->update();
+
+	if( mCubeTextureUpload.valid() && mCubeTextureUpload.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready ) {
+		mCubeTexture = mCubeTextureUpload.get();
+		mCubeTextureUpload = std::shared_future<gl::Texture2dRef>();
+	}
 }
 
 void HelloVrApp::draw()
 {
 	gl::clear( Color( 0.15f, 0.15f, 0.18f ) );
-	if( mVive ) {
+	if( mVive && mVive->isReady() ) {
 		hmd::ScopedVive bind{ mVive };
-		mVive->renderStereoTargets( std::bind( &HelloVrApp::renderScene, this, std::placeholders::_1 ) );
+		if( mVive->isFarFieldEnabled() ) {
+			// the grid is one instanced draw, so both passes submit it and the split planes clip it
+			mVive->renderHybridStereoTargets( [this]( const hmd::FrameView& ) { renderScene( vr::Eye_Left ); }, [this]( vr::Hmd_Eye ) { drawCubes(); } );
+		}
+		else {
+			mVive->renderStereoTargets( std::bind( &HelloVrApp::renderScene, this, std::placeholders::_1 ) );
+		}
 		mVive->renderDistortion( app::getWindowSize() );
 	}
 }
@@ -109,6 +135,30 @@ void HelloVrApp::keyDown( KeyEvent event )
 	if( event.getCode() == KeyEvent::KEY_ESCAPE ) {
 		quit();
 	}
+	else if( ! mVive || ! mVive->isReady() ) {
+		return;
+	}
+	else if( event.getChar() == 'm' ) {
+		auto mode = static_cast<hmd::HtcVive::DistortionMode>( ( mVive->getDistortionMode() + 1 ) % hmd::HtcVive::DISTORTION_MODE_COUNT );
+		mVive->setDistortionMode( mode );
+	}
+	else if( event.getChar() == 'g' ) {
+		bool greenOnly = mVive->getDistortionQuality() == hmd::HtcVive::DISTORTION_QUALITY_GREEN_ONLY;
+		mVive->setDistortionQuality( greenOnly ? hmd::HtcVive::DISTORTION_QUALITY_FULL : hmd::HtcVive::DISTORTION_QUALITY_GREEN_ONLY );
+	}
+	else if( event.getChar() == 'r' ) {
+		mVive->setRadialDensityMask( ! mVive->isRadialDensityMaskEnabled() );
+		CI_LOG_I( "Radial density mask skips " << mVive->getRadialDensityMaskCoverage() * 100.0f << "% of each eye." );
+	}
+	else if( event.getChar() == 'f' ) {
+		// close enough that the far corners of the grid land in the far field
+		mVive->setFarField( ! mVive->isFarFieldEnabled(), 15.0f );
+	}
+	else if( event.getChar() == 'b' ) {
+		for( const auto& timing : mVive->benchmarkDistortion( getWindowSize() ) ) {
+			CI_LOG_I( "mode " << timing.mode << ", quality " << timing.quality << ": " << timing.gpuMilliseconds << " ms GPU" );
+		}
+	}
 }
 
 void prepareSettings( App::Settings* settings )
@@ -0,0 +1,31 @@
+#version 410
+
+uniform sampler2D	uTex0;
+uniform int			uLightCount;	// 0 is unlit, the per-fragment cost grows linearly
+uniform float		uTime;
+
+in vec3		WorldPosition;
+in vec3		Normal;
+in vec2		TexCoord;
+out vec4	oColor;
+
+void main( void )
+{
+	vec4 albedo = texture( uTex0, TexCoord.st );
+	if( uLightCount == 0 ) {
+		oColor = albedo;
+		return;
+	}
+
+	vec3 normal = normalize( Normal );
+	vec3 color = albedo.rgb * 0.05;
+	for( int i = 0; i < uLightCount; ++i ) {
+		// lights spread on a golden angle spiral, orbiting with time
+		float angle = float( i ) * 2.399963 + uTime;
+		vec3 lightPosition = vec3( cos( angle ) * 20.0, sin( float( i ) * 0.7 ) * 20.0, sin( angle ) * 20.0 );
+		vec3 toLight = lightPosition - WorldPosition;
+		float distance = length( toLight );
+		color += albedo.rgb * max( dot( normal, toLight / distance ), 0.0 ) * 40.0 / ( 1.0 + distance * distance );
+	}
+	oColor = vec4( color, albedo.a );
+}
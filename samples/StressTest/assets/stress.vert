@@ -0,0 +1,23 @@
+#version 410
+
+uniform mat4			ciModelMatrix;
+uniform mat4			ciViewProjection;
+uniform samplerBuffer	uInstances;			// xyz position, w phase
+uniform int				uInstanceOffset;	// first instance of the region written this frame
+
+in vec4		ciPosition;
+in vec3		ciNormal;
+in vec2		ciTexCoord0;
+out vec3	WorldPosition;
+out vec3	Normal;
+out vec2	TexCoord;
+
+void main( void )
+{
+	vec4 instance	= texelFetch( uInstances, uInstanceOffset + gl_InstanceID );
+	vec4 world		= ciModelMatrix * vec4( ciPosition.xyz + instance.xyz, 1 );
+	WorldPosition	= world.xyz;
+	Normal			= ciNormal;
+	TexCoord		= ciTexCoord0;
+	gl_Position		= ciViewProjection * world;
+}
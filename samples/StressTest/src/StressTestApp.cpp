@@ -0,0 +1,445 @@
+#include "cinder/app/App.h"
+#include "cinder/app/RendererGl.h"
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Query.h"
+#include "cinder/Timer.h"
+#include "cinder/Utilities.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include "CinderVive.h"
+
+using namespace ci;
+using namespace ci::app;
+using namespace std;
+using namespace hmd;
+
+//! Repeatable load for profiling the block: a configurable instanced cube grid seen from a scripted
+//! camera path, with per-frame CPU and GPU timings written at exit. Usage, all optional:
+//!   --instances 9261 --lights 0 --update static|stream|persistent --path orbit|flythrough
+//!   --frames 2000 --warmup 90 --output stress_timings.csv --pipelined --mask
+class StressTestApp : public App {
+public:
+	StressTestApp();
+
+	void update() override;
+	void draw() override;
+	void cleanup() override;
+	void keyDown( KeyEvent event ) override;
+
+	void finishDraw();
+	void renderScene( vr::Hmd_Eye eye );
+private:
+	void renderFrame();
+	enum UpdateMode { UPDATE_STATIC, UPDATE_STREAM, UPDATE_PERSISTENT };
+	enum PathMode { PATH_ORBIT, PATH_FLYTHROUGH };
+
+	struct FrameTiming {
+		uint64_t	frame;
+		double		cpuMilliseconds;	// without the pose wait, which paces the frame rather than costing CPU
+		double		poseWaitMilliseconds;
+		double		gpuMilliseconds;	// filled in a frame later, the query is read back double-buffered
+		bool		gpuResolved;		// false for the last frame, whose query is never read back
+		uint32_t	drawCalls;			// the sample's instanced draws plus the block's own
+		uint64_t	maskedPixels;
+	};
+
+	void parseArguments();
+	void setupInstances();
+	void updateInstances();
+	mat4 getScriptedWorldPose() const;
+	void writeTimings();
+
+	hmd::HtcViveRef		mVive;
+
+	gl::Texture2dRef	mCubeTexture;
+	gl::BatchRef		mCubeBatch;
+	gl::GlslProgRef		mCubeGlsl;
+
+	// configuration
+	int					mInstanceCount;
+	int					mLightCount;
+	UpdateMode			mUpdateMode;
+	PathMode			mPathMode;
+	uint64_t			mFrameLimit;
+	uint64_t			mWarmupFrames;
+	fs::path			mOutputPath;
+	bool				mPipelined;
+	bool				mDensityMask;
+
+	// instance data, in a texture buffer so every update mode shares one shader
+	static const int	kPersistentRegions = 3;
+	std::vector<vec4>	mInstances;
+	std::vector<vec4>	mBasePositions;
+	GLuint				mInstanceBuffer;
+	GLuint				mInstanceTexture;
+	vec4 *				mPersistentData;
+	GLsync				mRegionFences[kPersistentRegions];
+	int					mRegion;
+
+	// scripted time advances a fixed step per rendered frame, never with the wall clock
+	uint64_t			mFrame;
+	uint32_t			mSceneDrawCalls;	// GlInstrument only sees the block's draws, not renderScene()'s
+	Timer				mCpuTimer;
+	Timer				mPoseWaitTimer;
+	double				mUpdateMilliseconds;
+	gl::QueryTimeSwappedRef	mGpuTimer;
+	std::vector<FrameTiming>	mTimings;
+};
+
+static const double kFrameStep = 1.0 / 90.0;
+static const float kSpacing = 2.0f;
+
+StressTestApp::StressTestApp()
+	: mInstanceCount( 21 * 21 * 21 )
+	, mLightCount( 0 )
+	, mUpdateMode( UPDATE_STATIC )
+	, mPathMode( PATH_ORBIT )
+	, mFrameLimit( 2000 )
+	, mWarmupFrames( 90 )
+	, mOutputPath( getAppPath() / "stress_timings.csv" )
+	, mPipelined( false )
+	, mDensityMask( false )
+	, mInstanceBuffer( 0 )
+	, mInstanceTexture( 0 )
+	, mPersistentData( nullptr )
+	, mRegion( 0 )
+	, mFrame( 0 )
+	, mSceneDrawCalls( 0 )
+	, mUpdateMilliseconds( 0 )
+{
+	parseArguments();
+
+	auto rgl = static_cast<RendererGl *>(getWindow()->getRenderer().get());
+	rgl->setFinishDrawFn( std::bind( &StressTestApp::finishDraw, this ) );
+
+	try {
+		mVive = hmd::HtcVive::create( hmd::HtcVive::Options().programCacheDirectory( getAppPath() / "programcache" ) );
+		mVive->setPipelined( mPipelined );
+		mVive->setRadialDensityMask( mDensityMask );
+	}
+	catch( const std::exception& exc ) {
+		CI_LOG_E( exc.what() );
+	}
+
+	// the cube texture is HelloVr's, looked up next to this sample's assets rather than committed twice
+	addAssetDirectory( getAssetPath( "stress.frag" ).parent_path() / ".." / ".." / "HelloVr" / "assets" );
+
+	gl::Texture2d::Format fmt;
+	fmt.mipmap( true );
+	fmt.loadTopDown();
+	mCubeTexture = gl::Texture2d::create( loadImage( loadAsset( "cube_texture.png" ) ), fmt );
+
+	mCubeGlsl = gl::GlslProg::create( gl::GlslProg::Format().vertex( loadAsset( "stress.vert" ) ).fragment( loadAsset( "stress.frag" ) ) );
+	mCubeGlsl->uniform( "uTex0", 0 );
+	mCubeGlsl->uniform( "uInstances", 1 );
+	mCubeGlsl->uniform( "uLightCount", mLightCount );
+	mCubeBatch = gl::Batch::create( geom::Cube().size( vec3( 0.5f ) ), mCubeGlsl );
+
+	setupInstances();
+	mGpuTimer = gl::QueryTimeSwapped::create();
+	mTimings.reserve( static_cast<size_t>( mFrameLimit ) );
+
+	CI_LOG_I( "Stress test: " << mInstanceCount << " instances, " << mLightCount << " lights, update mode " << mUpdateMode
+		<< ", path " << mPathMode << ", " << mFrameLimit << " frames after " << mWarmupFrames << " warmup frames." );
+}
+
+void StressTestApp::parseArguments()
+{
+	const auto& args = getCommandLineArgs();
+	for( size_t i = 1; i < args.size(); ++i ) {
+		const string& arg = args[i];
+		bool hasValue = i + 1 < args.size();
+
+		if( arg == "--pipelined" )
+			mPipelined = true;
+		else if( arg == "--mask" )
+			mDensityMask = true;
+		else if( ! hasValue )
+			CI_LOG_W( "Ignoring argument " << arg );
+		else if( arg == "--instances" )
+			mInstanceCount = std::max( 1, fromString<int>( args[++i] ) );
+		else if( arg == "--lights" )
+			mLightCount = std::max( 0, fromString<int>( args[++i] ) );
+		else if( arg == "--frames" )
+			mFrameLimit = fromString<uint64_t>( args[++i] );
+		else if( arg == "--warmup" )
+			mWarmupFrames = fromString<uint64_t>( args[++i] );
+		else if( arg == "--output" )
+			mOutputPath = args[++i];
+		else if( arg == "--update" ) {
+			const string& mode = args[++i];
+			mUpdateMode = mode == "persistent" ? UPDATE_PERSISTENT : mode == "stream" ? UPDATE_STREAM : UPDATE_STATIC;
+		}
+		else if( arg == "--path" )
+			mPathMode = args[++i] == "flythrough" ? PATH_FLYTHROUGH : PATH_ORBIT;
+		else
+			CI_LOG_W( "Ignoring argument " << arg );
+	}
+}
+
+void StressTestApp::setupInstances()
+{
+	// smallest cube of cells holding every instance, centered on the origin
+	int side = static_cast<int>( std::ceil( std::cbrt( float( mInstanceCount ) ) ) );
+	float origin = ( side - 1 ) * kSpacing * 0.5f;
+	for( int i = 0; i < mInstanceCount; ++i ) {
+		vec3 cell( i % side, ( i / side ) % side, i / ( side * side ) );
+		mBasePositions.push_back( vec4( cell * kSpacing - vec3( origin ), float( i ) * 0.37f ) );
+	}
+	mInstances = mBasePositions;
+
+	if( mUpdateMode == UPDATE_PERSISTENT ) {
+		auto version = gl::getVersion();
+		bool bufferStorage = version.first > 4 || ( version.first == 4 && version.second >= 4 ) || gl::isExtensionAvailable( "GL_ARB_buffer_storage" );
+		if( ! bufferStorage ) {
+			CI_LOG_W( "Persistent mapping needs GL 4.4 or ARB_buffer_storage, falling back to stream updates." );
+			mUpdateMode = UPDATE_STREAM;
+		}
+	}
+
+	for( auto& fence : mRegionFences )
+		fence = nullptr;
+
+	size_t regionBytes = mInstances.size() * sizeof( vec4 );
+	glGenBuffers( 1, &mInstanceBuffer );
+	{
+		gl::ScopedBuffer scopedBuffer{ GL_TEXTURE_BUFFER, mInstanceBuffer };
+		if( mUpdateMode == UPDATE_PERSISTENT ) {
+			// one region per frame in flight, written while the GPU reads the others
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage( GL_TEXTURE_BUFFER, regionBytes * kPersistentRegions, nullptr, flags );
+			mPersistentData = static_cast<vec4 *>( glMapBufferRange( GL_TEXTURE_BUFFER, 0, regionBytes * kPersistentRegions, flags ) );
+			if( mPersistentData ) {
+				for( int region = 0; region < kPersistentRegions; ++region )
+					std::copy( mInstances.begin(), mInstances.end(), mPersistentData + region * mInstances.size() );
+			}
+			else {
+				// immutable storage can't be respecified, so the stream path gets a fresh buffer
+				CI_LOG_W( "Mapping the instance buffer failed, falling back to stream updates." );
+				glDeleteBuffers( 1, &mInstanceBuffer );
+				glGenBuffers( 1, &mInstanceBuffer );
+				gl::context()->bindBuffer( GL_TEXTURE_BUFFER, mInstanceBuffer );
+				mUpdateMode = UPDATE_STREAM;
+			}
+		}
+
+		if( mUpdateMode != UPDATE_PERSISTENT ) {
+			glBufferData( GL_TEXTURE_BUFFER, regionBytes, mInstances.data(), mUpdateMode == UPDATE_STREAM ? GL_STREAM_DRAW : GL_STATIC_DRAW );
+		}
+	}
+
+	glGenTextures( 1, &mInstanceTexture );
+	gl::ScopedTextureBind scopedTexture{ GL_TEXTURE_BUFFER, mInstanceTexture, 1 };
+	glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, mInstanceBuffer );
+}
+
+void StressTestApp::updateInstances()
+{
+	if( mUpdateMode == UPDATE_STATIC )
+		return;
+
+	float time = static_cast<float>( mFrame * kFrameStep );
+	for( size_t i = 0; i < mInstances.size(); ++i ) {
+		const vec4& base = mBasePositions[i];
+		mInstances[i] = base + vec4( 0, 0.25f * std::sin( time * 2.0f + base.w ), 0, 0 );
+	}
+
+	if( mUpdateMode == UPDATE_STREAM ) {
+		// orphan, so the driver hands out fresh storage instead of waiting for last frame's draws
+		gl::ScopedBuffer scopedBuffer{ GL_TEXTURE_BUFFER, mInstanceBuffer };
+		glBufferData( GL_TEXTURE_BUFFER, mInstances.size() * sizeof( vec4 ), nullptr, GL_STREAM_DRAW );
+		glBufferSubData( GL_TEXTURE_BUFFER, 0, mInstances.size() * sizeof( vec4 ), mInstances.data() );
+		return;
+	}
+
+	mRegion = ( mRegion + 1 ) % kPersistentRegions;
+	GLsync& fence = mRegionFences[mRegion];
+	if( fence ) {
+		glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64( 1000000000 ) );
+		glDeleteSync( fence );
+		fence = nullptr;
+	}
+	std::copy( mInstances.begin(), mInstances.end(), mPersistentData + mRegion * mInstances.size() );
+}
+
+mat4 StressTestApp::getScriptedWorldPose() const
+{
+	float time = static_cast<float>( mFrame * kFrameStep );
+	float extent = std::ceil( std::cbrt( float( mInstanceCount ) ) ) * kSpacing * 0.5f;
+
+	vec3 eye, target;
+	if( mPathMode == PATH_FLYTHROUGH ) {
+		// back and forth along z between two columns of cubes, 20 seconds per pass
+		float pass = std::fmod( time / 20.0f, 2.0f );
+		float z = ( extent + 4.0f ) * ( pass < 1.0f ? 1.0f - 2.0f * pass : 2.0f * pass - 3.0f );
+		float direction = pass < 1.0f ? -1.0f : 1.0f;
+		eye = vec3( kSpacing * 0.5f + 0.2f * std::sin( time ), 0.3f * std::sin( time * 0.7f ), z );
+		target = eye + vec3( 0, 0, direction );
+	}
+	else {
+		float radius = extent + 6.0f;
+		eye = vec3( radius * std::cos( time * 0.3f ), radius * 0.25f * std::sin( time * 0.2f ), radius * std::sin( time * 0.3f ) );
+		target = vec3( 0 );
+	}
+
+	// the scene is moved so the scripted camera sits where the tracked head is
+	return glm::lookAt( eye, target, vec3( 0, 1, 0 ) );
+}
+
+void StressTestApp::renderScene( vr::Hmd_Eye eye )
+{
+	gl::clear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	gl::ScopedDepth depth{ true };
+	gl::ScopedTextureBind tex0{ mCubeTexture, 0 };
+	gl::ScopedTextureBind tex1{ GL_TEXTURE_BUFFER, mInstanceTexture, 1 };
+	mCubeGlsl->uniform( "uInstanceOffset", mUpdateMode == UPDATE_PERSISTENT ? mRegion * mInstanceCount : 0 );
+	mCubeGlsl->uniform( "uTime", static_cast<float>( mFrame * kFrameStep ) );
+	mCubeBatch->drawInstanced( mInstanceCount );
+	++mSceneDrawCalls;
+}
+
+void StressTestApp::update()
+{
+	mCpuTimer.start();
+	if( mVive )
+		mVive->update();
+	mCpuTimer.stop();
+	mUpdateMilliseconds = mCpuTimer.getSeconds() * 1000.0;
+}
+
+void StressTestApp::draw()
+{
+	gl::clear( Color( 0.15f, 0.15f, 0.18f ) );
+	if( ! mVive ) {
+		// an unattended run would otherwise never exit
+		CI_LOG_E( "No headset, stopping the stress test." );
+		quit();
+		return;
+	}
+
+	// frames keep counting while the block isn't ready, so a run that never gets there still ends
+	if( mVive->isReady() )
+		renderFrame();
+
+	if( ++mFrame >= mWarmupFrames + mFrameLimit )
+		quit();
+}
+
+void StressTestApp::renderFrame()
+{
+	mCpuTimer.start();
+	updateInstances();
+	mSceneDrawCalls = 0;
+
+	double cpuMilliseconds = mUpdateMilliseconds;
+	mGpuTimer->begin();
+	{
+		// binding waits for the poses, the timer restarts once they're in
+		mCpuTimer.stop();
+		cpuMilliseconds += mCpuTimer.getSeconds() * 1000.0;
+		mPoseWaitTimer.start();
+		hmd::ScopedVive bind{ mVive };
+		mPoseWaitTimer.stop();
+		mCpuTimer.start();
+
+		mVive->renderStereoTargets( std::bind( &StressTestApp::renderScene, this, std::placeholders::_1 ), getScriptedWorldPose() );
+		mVive->renderDistortion( app::getWindowSize() );
+	}
+	mGpuTimer->end();
+
+	if( mUpdateMode == UPDATE_PERSISTENT )
+		mRegionFences[mRegion] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+
+	mCpuTimer.stop();
+	cpuMilliseconds += mCpuTimer.getSeconds() * 1000.0;
+
+	// the swapped query returns the previous frame's time
+	if( ! mTimings.empty() && mTimings.back().frame + 1 == mFrame ) {
+		mTimings.back().gpuMilliseconds = mGpuTimer->getElapsedMilliseconds();
+		mTimings.back().gpuResolved = true;
+	}
+
+	if( mFrame >= mWarmupFrames ) {
+		const GlCallStats& stats = mVive->getGlInstrument().getCurrentStats();
+		FrameTiming timing;
+		timing.frame = mFrame;
+		timing.cpuMilliseconds = cpuMilliseconds;
+		timing.poseWaitMilliseconds = mPoseWaitTimer.getSeconds() * 1000.0;
+		timing.gpuMilliseconds = 0;
+		timing.gpuResolved = false;
+		timing.drawCalls = stats.drawCalls + mSceneDrawCalls;
+		timing.maskedPixels = stats.maskedPixels;
+		mTimings.push_back( timing );
+	}
+}
+
+static double percentile( std::vector<double> values, double fraction )
+{
+	if( values.empty() )
+		return 0;
+
+	size_t index = std::min( values.size() - 1, static_cast<size_t>( fraction * values.size() ) );
+	std::nth_element( values.begin(), values.begin() + index, values.end() );
+	return values[index];
+}
+
+void StressTestApp::writeTimings()
+{
+	std::ofstream file( mOutputPath.string() );
+	file << "frame,cpu_ms,pose_wait_ms,gpu_ms,draw_calls,masked_pixels\n";
+	std::vector<double> cpu, poseWait, gpu;
+	for( const auto& timing : mTimings ) {
+		// a frame without its GPU time would skew the GPU percentiles toward zero
+		if( ! timing.gpuResolved )
+			continue;
+
+		file << timing.frame << "," << timing.cpuMilliseconds << "," << timing.poseWaitMilliseconds << "," << timing.gpuMilliseconds << "," << timing.drawCalls << "," << timing.maskedPixels << "\n";
+		cpu.push_back( timing.cpuMilliseconds );
+		poseWait.push_back( timing.poseWaitMilliseconds );
+		gpu.push_back( timing.gpuMilliseconds );
+	}
+
+	CI_LOG_I( "Wrote " << cpu.size() << " frames to " << mOutputPath );
+	CI_LOG_I( "CPU ms p50 " << percentile( cpu, 0.5 ) << ", p95 " << percentile( cpu, 0.95 ) << ", p99 " << percentile( cpu, 0.99 ) );
+	CI_LOG_I( "Pose wait ms p50 " << percentile( poseWait, 0.5 ) << ", p95 " << percentile( poseWait, 0.95 ) << ", p99 " << percentile( poseWait, 0.99 ) );
+	CI_LOG_I( "GPU ms p50 " << percentile( gpu, 0.5 ) << ", p95 " << percentile( gpu, 0.95 ) << ", p99 " << percentile( gpu, 0.99 ) );
+}
+
+void StressTestApp::cleanup()
+{
+	writeTimings();
+
+	if( mPersistentData ) {
+		for( auto& fence : mRegionFences ) {
+			if( fence )
+				glDeleteSync( fence );
+		}
+		gl::ScopedBuffer scopedBuffer{ GL_TEXTURE_BUFFER, mInstanceBuffer };
+		glUnmapBuffer( GL_TEXTURE_BUFFER );
+	}
+	glDeleteTextures( 1, &mInstanceTexture );
+	glDeleteBuffers( 1, &mInstanceBuffer );
+}
+
+void StressTestApp::finishDraw()
+{
+	auto rgl = static_cast<RendererGl *>(getWindow()->getRenderer().get());
+	rgl->swapBuffers();
+}
+
+void StressTestApp::keyDown( KeyEvent event )
+{
+	if( event.getCode() == KeyEvent::KEY_ESCAPE ) {
+		quit();
+	}
+}
+
+void prepareSettings( App::Settings* settings )
+{
+	settings->setWindowSize( 1280, 720 );
+	settings->disableFrameRate();
+}
+
+CINDER_APP( StressTestApp, RendererGl( RendererGl::Options().msaa( 0 ) ), prepareSettings )
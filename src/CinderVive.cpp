@@ -1,59 +1,213 @@
 #include "CinderVive.h"
+#include "cinder/Timer.h"
 
 using namespace ci;
 using namespace std;
 using namespace hmd;
 
-std::string GetTrackedDeviceString( vr::IVRSystem *pHmd, vr::TrackedDeviceIndex_t unDevice, vr::TrackedDeviceProperty prop, vr::TrackedPropertyError *peError = NULL )
+RenderModel::RenderModel( const std::string & sRenderModelName, const QuantizedMesh & mesh, const vr::RenderModel_TextureMap_t & vrDiffuseTexture, GLuint program )
+	: mIndexCount( static_cast<GLsizei>( mesh.indices.size() ) )
+	, mProgram( program )
+	, mPositionScale( mesh.positionScale )
+	, mPositionOffset( mesh.positionOffset )
+	, mTexCoordScale( mesh.texCoordScale )
+	, mTexCoordOffset( mesh.texCoordOffset )
+	, mModelName( sRenderModelName )
+	, mGpuBytes( 0 )
 {
-	uint32_t unRequiredBufferLen = pHmd->GetStringTrackedDeviceProperty( unDevice, prop, NULL, 0, peError );
-	if( unRequiredBufferLen == 0 )
-		return "";
+	mVertexVbo = ci::gl::Vbo::create( GL_ARRAY_BUFFER, sizeof( QuantizedVertex ) * mesh.vertices.size(), mesh.vertices.data(), GL_STATIC_DRAW );
+	mIndexVbo = ci::gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, sizeof( uint16_t ) * mesh.indices.size(), mesh.indices.data(), GL_STATIC_DRAW );
 
-	char *pchBuffer = new char[unRequiredBufferLen];
-	unRequiredBufferLen = pHmd->GetStringTrackedDeviceProperty( unDevice, prop, pchBuffer, unRequiredBufferLen, peError );
-	std::string sResult = pchBuffer;
-	delete[] pchBuffer;
-	return sResult;
+	ci::Surface8u surface{ const_cast<uint8_t *>(vrDiffuseTexture.rubTextureMapData), vrDiffuseTexture.unWidth, vrDiffuseTexture.unHeight, 4 * vrDiffuseTexture.unWidth, ci::SurfaceChannelOrder::RGBA };
+	mTexture = ci::gl::Texture2d::create( surface );
+
+	setupVao();
 }
 
-RenderModel::RenderModel( const std::string & sRenderModelName, const vr::RenderModel_t & vrModel, const vr::RenderModel_TextureMap_t & vrDiffuseTexture, gl::GlslProgRef shader )
-	: mModelName( sRenderModelName )
+RenderModel::RenderModel( const std::string & sRenderModelName, const QuantizedMesh & mesh, const gl::VboRef & vertexVbo, const gl::VboRef & indexVbo, const gl::Texture2dRef & texture, GLuint program )
+	: mVertexVbo( vertexVbo )
+	, mIndexVbo( indexVbo )
+	, mIndexCount( static_cast<GLsizei>( mesh.indices.size() ) )
+	, mProgram( program )
+	, mPositionScale( mesh.positionScale )
+	, mPositionOffset( mesh.positionOffset )
+	, mTexCoordScale( mesh.texCoordScale )
+	, mTexCoordOffset( mesh.texCoordOffset )
+	, mTexture( texture )
+	, mModelName( sRenderModelName )
+	, mGpuBytes( 0 )
 {
-	auto indicesVbo = ci::gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, sizeof( uint16_t ) * vrModel.unTriangleCount * 3, vrModel.rIndexData, GL_STATIC_DRAW );
-	auto layout = ci::gl::VboMesh::Layout().usage( GL_STATIC_DRAW ) //.interleave( false )
-		.attrib( ci::geom::Attrib::POSITION, 3 )
-		.attrib( ci::geom::Attrib::NORMAL, 3 )
-		.attrib( ci::geom::Attrib::TEX_COORD_0, 2 );
-	auto vboMesh = ci::gl::VboMesh::create( vrModel.unVertexCount, GL_TRIANGLES, { layout }, vrModel.unTriangleCount * 3, GL_UNSIGNED_SHORT, indicesVbo );
+	setupVao();
+}
 
-	ci::Surface8u surface{ const_cast<uint8_t *>(vrDiffuseTexture.rubTextureMapData), vrDiffuseTexture.unWidth, vrDiffuseTexture.unHeight, 4 * vrDiffuseTexture.unWidth, ci::SurfaceChannelOrder::RGBA };
-	mTexture = ci::gl::Texture2d::create( surface );
+void RenderModel::setupVao()
+{
+	// Cinder's VboMesh layouts are float only, so the normalized integer attributes are set up by hand
+	mVao = ci::gl::Vao::create();
+	{
+		ci::gl::ScopedVao scopedVao{ mVao };
+		mVertexVbo->bind();
+		mIndexVbo->bind();
+
+		const GLsizei stride = sizeof( QuantizedVertex );
+		GLint position = glGetAttribLocation( mProgram, "ciPosition" );
+		GLint normal = glGetAttribLocation( mProgram, "ciNormal" );
+		GLint texCoord = glGetAttribLocation( mProgram, "ciTexCoord0" );
+		if( position >= 0 ) {
+			ci::gl::enableVertexAttribArray( position );
+			ci::gl::vertexAttribPointer( position, 3, GL_SHORT, GL_TRUE, stride, (const GLvoid*)offsetof( QuantizedVertex, position ) );
+		}
+		if( normal >= 0 ) {
+			ci::gl::enableVertexAttribArray( normal );
+			ci::gl::vertexAttribPointer( normal, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (const GLvoid*)offsetof( QuantizedVertex, normal ) );
+		}
+		if( texCoord >= 0 ) {
+			ci::gl::enableVertexAttribArray( texCoord );
+			ci::gl::vertexAttribPointer( texCoord, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (const GLvoid*)offsetof( QuantizedVertex, texCoord ) );
+		}
+	}
 
-	mBatch = ci::gl::Batch::create( vboMesh, shader );
-	mBatch->getGlslProg()->uniform( "diffuse", 0 );
+	mGpuBytes = mVertexVbo->getSize() + mIndexVbo->getSize() + uint64_t( mTexture->getWidth() ) * mTexture->getHeight() * 4;
 }
 
-void RenderModel::draw()
+void RenderModel::draw( GlInstrument& gl )
 {
-	ci::gl::ScopedTextureBind tex0{ mTexture, 0 };
-	mBatch->draw();
+	// a raw program, so the uniforms Cinder's default shader vars would set are set here
+	if( ! gl.isNull() ) {
+		const mat4 modelViewProjection = ci::gl::getProjectionMatrix() * ci::gl::getViewMatrix() * ci::gl::getModelMatrix();
+		glProgramUniform1i( mProgram, glGetUniformLocation( mProgram, "diffuse" ), 0 );
+		glProgramUniformMatrix4fv( mProgram, glGetUniformLocation( mProgram, "ciModelViewProjection" ), 1, GL_FALSE, &modelViewProjection[0][0] );
+		glProgramUniform3fv( mProgram, glGetUniformLocation( mProgram, "positionScale" ), 1, &mPositionScale[0] );
+		glProgramUniform3fv( mProgram, glGetUniformLocation( mProgram, "positionOffset" ), 1, &mPositionOffset[0] );
+		glProgramUniform2fv( mProgram, glGetUniformLocation( mProgram, "texCoordScale" ), 1, &mTexCoordScale[0] );
+		glProgramUniform2fv( mProgram, glGetUniformLocation( mProgram, "texCoordOffset" ), 1, &mTexCoordOffset[0] );
+	}
+
+	gl.bindTexture( mTexture, 0 );
+	gl.bindVao( mVao );
+	gl.useProgram( mProgram );
+	gl.drawElements( GL_TRIANGLES, mIndexCount, GL_UNSIGNED_SHORT, 0 );
 }
 
+void DrawList::push( const gl::BatchRef& batch, const glm::mat4& modelMatrix, const gl::TextureRef& texture, GLsizei instanceCount )
+{
+	DrawItem item;
+	item.batch = batch;
+	item.texture = texture;
+	item.modelMatrix = modelMatrix;
+	item.instanceCount = instanceCount;
+	item.sortDepth = 0.0f;
+	mItems.push_back( item );
+}
+
+void DrawList::sortFrontToBack( const glm::mat4& viewMatrix )
+{
+	for( auto& item : mItems ) {
+		item.sortDepth = - ( viewMatrix * item.modelMatrix[3] ).z;
+	}
+
+	std::sort( std::begin( mItems ), std::end( mItems ), []( const DrawItem& a, const DrawItem& b ) {
+		auto progA = a.batch->getGlslProg().get();
+		auto progB = b.batch->getGlslProg().get();
+		if( progA != progB )
+			return progA < progB;
+		return a.sortDepth < b.sortDepth;
+	} );
+}
 
-HtcVive::HtcVive()
+static void drawItem( const DrawItem& item )
+{
+	if( item.instanceCount > 0 )
+		item.batch->drawInstanced( item.instanceCount );
+	else
+		item.batch->draw();
+}
+
+void DrawList::execute() const
+{
+	for( const auto& item : mItems ) {
+		gl::ScopedModelMatrix push;
+		gl::setModelMatrix( item.modelMatrix );
+		if( item.texture ) {
+			gl::ScopedTextureBind tex0{ item.texture, 0 };
+			drawItem( item );
+		}
+		else {
+			drawItem( item );
+		}
+	}
+}
+
+
+ViewFormat::ViewFormat()
+	: mSize( 1280, 720 )
+	, mFov( 60.0f )
+	, mNearClip( 0.1f )
+	, mFarClip( 37.0f )
+	, mHasProjection( false )
+	, mDevice( vr::k_unTrackedDeviceIndexInvalid )
+	, mUpdateDivisor( 1 )
+{
+}
+
+glm::mat4 ViewFormat::getProjection() const
+{
+	if( mHasProjection )
+		return mProjection;
+
+	return glm::perspective( glm::radians( mFov ), mSize.x / (float)mSize.y, mNearClip, mFarClip );
+}
+
+
+HtcVive::HtcVive( const Options& options )
 	: mHMD( nullptr )
 	, m_pRenderModels( nullptr )
 	, m_glControllerVertBuffer( 0 )
 	, m_unControllerVAO( 0 )
-	, m_unLensVAO( 0 )
+	, mDistortionMode( DISTORTION_MESH )
+	, mDistortionQuality( DISTORTION_QUALITY_FULL )
+	, mLookupBakeProgram( 0 )
+	, mLookupFramebuffer( 0 )
+	, mComputeFramebuffer( 0 )
+	, mDensityMaskEnabled( false )
+	, mDensityMaskRadius( 0.6f )
+	, mDensityMaskStrength( 0.5f )
+	, mDensityMaskProgram( 0 )
+	, mDensityReconstructProgram( 0 )
+	, mFarFieldEnabled( false )
+	, mFarFieldSplit( 25.0f )
+	, mFarFieldFarClip( 1000.0f )
+	, mFarFieldOverlap( 0.5f )
+	, mFarFieldCompositeProgram( 0 )
+	, mModelProgram( 0 )
 	, m_nControllerMatrixLocation( -1 )
 	, m_iTrackedControllerCount( 0 )
 	, m_iTrackedControllerCount_Last( -1 )
 	, m_iValidPoseCount( 0 )
 	, m_iValidPoseCount_Last( -1 )
+	, mRenderModels( [this]( const std::string& name ) { return loadRenderModel( name ); } )
+	, mFrameIndex( 0 )
+	, mPosePrediction( 0 )
+	, mPrevReadFramebuffer( 0 )
+	, mPrevDrawFramebuffer( 0 )
+	, mPrevMultisample( false )
+	, mInitStage( 0 )
+	, mInitFailed( false )
+	, mReadyFn( options.getReadyFn() )
 {
 	memset( m_rDevClassChar, 0, sizeof( m_rDevClassChar ) );
+	memset( mDistortionPrograms, 0, sizeof( mDistortionPrograms ) );
+	memset( mDensityMaskPixels, 0, sizeof( mDensityMaskPixels ) );
+	// the eyes are views 0 and 1 from the start, views added before the cameras stage come after them
+	mViews.resize( 2 );
+	mViewDrawLists.resize( 2 );
+	mFrameState.frameIndex = 0;
+	mFarFieldView.active = false;
+	for( auto& submission : mEyeSubmissions ) {
+		submission.colorSpace = vr::ColorSpace_Gamma;
+		submission.bounds.uMin = submission.bounds.vMin = 0;
+		submission.bounds.uMax = submission.bounds.vMax = 1;
+	}
 
 	m_fNearClip = 0.1f;
 	m_fFarClip = 37.0f;
@@ -105,51 +259,266 @@ HtcVive::HtcVive()
 		throw ViveExeption{ "Unable to get render model interface: " + std::string{ vr::VR_GetVRInitErrorAsEnglishDescription( eError ) } };
 	}
 
-	mDriver = GetTrackedDeviceString( mHMD, vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_TrackingSystemName_String );
-	mDisplay = GetTrackedDeviceString( mHMD, vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_SerialNumber_String );
+	mDeviceProperties.setSystem( mHMD );
+	mEvents.setSystem( mHMD );
+	mChaperone.setChaperone( vr::VRChaperone(), vr::VRChaperoneSetup() );
+
+	// WaitGetPoses predicts for the frame scanned out after the next vsync
+	float displayFrequency = mHMD->GetFloatTrackedDeviceProperty( vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_DisplayFrequency_Float );
+	float vsyncToPhotons = mHMD->GetFloatTrackedDeviceProperty( vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_SecondsFromVsyncToPhotons_Float );
+	mPosePrediction = ( displayFrequency > 0 ? 1.0 / displayFrequency : 0.0 ) + vsyncToPhotons;
+	if( displayFrequency > 0 )
+		mPoseHistory.setWindow( mPoseHistory.getWindow(), displayFrequency );
+
+	mGl.detectCapabilities();
+	mProgramCache.setDirectory( options.getProgramCacheDirectory() );
+	if( options.hasBackgroundUploads() )
+		getUploadService();
+
+	beginInitialization();
+	if( ! options.isAsynchronous() ) {
+		while( ! isReady() ) {
+			pumpInitialization( true );
+		}
+	}
+}
+
+void HtcVive::beginInitialization()
+{
+	mReadyFuture = mReadyPromise.get_future().share();
+
+	// CPU-only stages; the device cache and decoded models aren't touched by the render thread until ready
+	auto& pool = getJobPool();
+	mDeviceJob = pool.enqueue( [this] { prefetchDevices(); } ).share();
+	mDistortionJob = pool.enqueue( [this] { buildDistortion(); } ).share();
+
+	// GL stages, run in order on the render thread
+	mInitStages.clear();
+	mInitStages.push_back( InitStage{ "shaders", std::shared_future<void>(), [this] { setupShaders(); } } );
+	mInitStages.push_back( InitStage{ "cameras", std::shared_future<void>(), [this] { setupCameras(); } } );
+	mInitStages.push_back( InitStage{ "render targets", std::shared_future<void>(), [this] { setupStereoRenderTargets(); } } );
+	mInitStages.push_back( InitStage{ "distortion", mDistortionJob, [this] { setupDistortion(); } } );
+	mInitStages.push_back( InitStage{ "render models", mDeviceJob, [this] { setupRenderModels(); } } );
+	mInitStages.push_back( InitStage{ "compositor", std::shared_future<void>(), [this] { setupCompositor(); } } );
+	mInitStage = 0;
+}
+
+bool HtcVive::pumpInitialization( bool block )
+{
+	if( isReady() || mInitFailed )
+		return false;
+
+	InitStage& stage = mInitStages[mInitStage];
+	if( stage.dependency.valid() && ! block && stage.dependency.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready )
+		return false;
+
+	try {
+		// rethrows a failed job
+		if( stage.dependency.valid() )
+			stage.dependency.get();
+
+		stage.fn();
+	}
+	catch( ... ) {
+		CI_LOG_E( "Initialization stage '" << stage.name << "' failed." );
+		mInitFailed = true;
+		waitForInitJobs();
+		mReadyPromise.set_exception( std::current_exception() );
+		if( block )
+			throw;
+		return false;
+	}
+
+	if( ++mInitStage == mInitStages.size() ) {
+		mReadyPromise.set_value();
+		if( mReadyFn )
+			mReadyFn();
+	}
+	return true;
+}
+
+void HtcVive::waitForInitJobs()
+{
+	if( mDeviceJob.valid() )
+		mDeviceJob.wait();
+	if( mDistortionJob.valid() )
+		mDistortionJob.wait();
+}
 
+static bool LoadRenderModelData( const std::string& name, vr::RenderModel_t **model, vr::RenderModel_TextureMap_t **texture )
+{
+	vr::EVRRenderModelError error;
+	while( ( error = vr::VRRenderModels()->LoadRenderModel_Async( name.c_str(), model ) ) == vr::VRRenderModelError_Loading ) {
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+	if( error != vr::VRRenderModelError_None || ! *model ) {
+		CI_LOG_E( "Unable to load render model " << name );
+		return false;
+	}
+
+	while( ( error = vr::VRRenderModels()->LoadTexture_Async( (*model)->diffuseTextureId, texture ) ) == vr::VRRenderModelError_Loading ) {
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+	if( error != vr::VRRenderModelError_None || ! *texture ) {
+		CI_LOG_E( "Unable to load render texture id " << (*model)->diffuseTextureId << " for render model " << name );
+		vr::VRRenderModels()->FreeRenderModel( *model );
+		return false;
+	}
 
-	setupShaders();
-	setupCameras();
-	setupStereoRenderTargets();
-	setupDistortion();
-	setupRenderModels();
-	setupCompositor();
+	return true;
 }
 
+std::unique_ptr<HtcVive::DecodedRenderModel> HtcVive::decodeRenderModel( const std::string& name, UploadService *uploads )
+{
+	vr::RenderModel_t *model = nullptr;
+	vr::RenderModel_TextureMap_t *texture = nullptr;
+	if( ! LoadRenderModelData( name, &model, &texture ) )
+		return nullptr;
+
+	// optimized here too, only the upload is left to the render thread
+	std::unique_ptr<DecodedRenderModel> decoded{ new DecodedRenderModel };
+	decoded->mesh = optimizeRenderModel( *model );
+	decoded->texture = texture;
+	vr::VRRenderModels()->FreeRenderModel( model );
+
+	// or to the upload service, leaving the render thread just the VAO
+	if( uploads ) {
+		decoded->vertexUpload = uploads->uploadBuffer( GL_ARRAY_BUFFER, decoded->mesh.vertices );
+		decoded->indexUpload = uploads->uploadBuffer( GL_ELEMENT_ARRAY_BUFFER, decoded->mesh.indices );
+		Surface8u surface{ const_cast<uint8_t *>( texture->rubTextureMapData ), texture->unWidth, texture->unHeight, 4 * texture->unWidth, SurfaceChannelOrder::RGBA };
+		decoded->textureUpload = uploads->uploadTexture( surface );
+		vr::VRRenderModels()->FreeTexture( texture );
+		decoded->texture = nullptr;
+	}
+
+	return decoded;
+}
+
+void HtcVive::prefetchDevices()
+{
+	mDeviceProperties.refreshAll();
+	mChaperone.refresh();
+
+	mDriver = mDeviceProperties.getTrackingSystemName( vr::k_unTrackedDeviceIndex_Hmd );
+	mDisplay = mDeviceProperties.getSerialNumber( vr::k_unTrackedDeviceIndex_Hmd );
+
+	// the runtime decodes models on its own threads; waiting for them here keeps the render thread free
+	for( auto id = vr::k_unTrackedDeviceIndex_Hmd + 1; id < vr::k_unMaxTrackedDeviceCount; id++ ) {
+		const std::string& name = mDeviceProperties.getRenderModelName( id );
+		if( ! mDeviceProperties.get( id ).isConnected || name.empty() || mDecodedRenderModels.count( name ) )
+			continue;
+
+		auto decoded = decodeRenderModel( name, mUploads.get() );
+		if( decoded )
+			mDecodedRenderModels[name] = std::move( *decoded );
+	}
+}
+
+void HtcVive::requestRenderModelDecode( const std::string& name )
+{
+	if( mDecodedRenderModels.count( name ) || mRenderModelDecodes.count( name ) )
+		return;
+
+	// devices activated after initialization take the same path the prefetch did
+	UploadService *uploads = mUploads.get();
+	mRenderModelDecodes[name] = getJobPool().enqueue( [name, uploads] { return decodeRenderModel( name, uploads ); } );
+}
+
+void HtcVive::pumpRenderModelDecodes()
+{
+	for( auto decodeIt = mRenderModelDecodes.begin(); decodeIt != mRenderModelDecodes.end(); ) {
+		if( decodeIt->second.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready ) {
+			++decodeIt;
+			continue;
+		}
+
+		const std::string name = decodeIt->first;
+		auto decoded = decodeIt->second.get();
+		decodeIt = mRenderModelDecodes.erase( decodeIt );
+		if( decoded )
+			mDecodedRenderModels[name] = std::move( *decoded );
+
+		for( vr::TrackedDeviceIndex_t id = 0; id < vr::k_unMaxTrackedDeviceCount; id++ ) {
+			if( mPendingRenderModels[id] != name )
+				continue;
+
+			mPendingRenderModels[id].clear();
+			if( decoded )
+				setupRenderModelForTrackedDevice( id );
+			else
+				CI_LOG_E( "Unable to load render model for tracked device " << id << " " << mDeviceProperties.getTrackingSystemName( id ) << " " << name );
+		}
+	}
+}
+
+
+static void DestroyFrameBuffer( FramebufferDesc &framebufferDesc )
+{
+	glDeleteRenderbuffers( 1, &framebufferDesc.m_nDepthBufferId );
+	glDeleteTextures( 1, &framebufferDesc.m_nRenderTextureId );
+	glDeleteFramebuffers( 1, &framebufferDesc.m_nRenderFramebufferId );
+	framebufferDesc.mResolveTexture.reset();
+	glDeleteFramebuffers( 1, &framebufferDesc.m_nResolveFramebufferId );
+}
 
 HtcVive::~HtcVive()
 {
+	waitForInitJobs();
+	for( auto& decode : mRenderModelDecodes ) {
+		auto decoded = decode.second.get();
+		if( decoded && decoded->texture )
+			vr::VRRenderModels()->FreeTexture( decoded->texture );
+	}
+	mRenderModelDecodes.clear();
+	// resolves every outstanding upload before the resources are released below
+	mUploads.reset();
+	for( auto& decoded : mDecodedRenderModels ) {
+		if( decoded.second.texture )
+			vr::VRRenderModels()->FreeTexture( decoded.second.texture );
+	}
+	mDecodedRenderModels.clear();
+
+	mTrackedDeviceToRenderModel.fill( nullptr );
+	mRenderModels.clear();
+
 	glDebugMessageControl( GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_FALSE );
 	glDebugMessageCallback( nullptr, nullptr );
-	glDeleteBuffers( 1, &m_glIDVertBuffer );
-	glDeleteBuffers( 1, &m_glIDIndexBuffer );
-
-	
-
-	glDeleteRenderbuffers( 1, &leftEyeDesc.m_nDepthBufferId );
-	glDeleteTextures( 1, &leftEyeDesc.m_nRenderTextureId );
-	glDeleteFramebuffers( 1, &leftEyeDesc.m_nRenderFramebufferId );
-	//glDeleteTextures( 1, &leftEyeDesc.m_nResolveTextureId );
-	leftEyeDesc.mResolveTexture.reset();
-	glDeleteFramebuffers( 1, &leftEyeDesc.m_nResolveFramebufferId );
-
-	glDeleteRenderbuffers( 1, &rightEyeDesc.m_nDepthBufferId );
-	glDeleteTextures( 1, &rightEyeDesc.m_nRenderTextureId );
-	glDeleteFramebuffers( 1, &rightEyeDesc.m_nRenderFramebufferId );
-	//glDeleteTextures( 1, &rightEyeDesc.m_nResolveTextureId );
-	rightEyeDesc.mResolveTexture.reset();
-	glDeleteFramebuffers( 1, &rightEyeDesc.m_nResolveFramebufferId );
-
-	if( m_unLensVAO != 0 )
-	{
-		glDeleteVertexArrays( 1, &m_unLensVAO );
+	mLensVao.reset();
+	mLensVbo.reset();
+	mLensIbo.reset();
+	releaseDistortionLookup();
+	mEmptyVao.reset();
+	mFrameContext.releasePasses();
+	for( auto& programs : mDistortionPrograms ) {
+		for( GLuint program : programs ) {
+			glDeleteProgram( program );
+		}
 	}
+	glDeleteProgram( mLookupBakeProgram );
+	glDeleteProgram( mDensityMaskProgram );
+	glDeleteProgram( mDensityReconstructProgram );
+	glDeleteProgram( mFarFieldCompositeProgram );
+	glDeleteProgram( mModelProgram );
+
+	for( auto& view : mViews ) {
+		DestroyFrameBuffer( view.framebuffer );
+	}
+	mViews.clear();
+
 	if( m_unControllerVAO != 0 )
 	{
 		glDeleteVertexArrays( 1, &m_unControllerVAO );
 	}
 
+	for( auto& overlay : mOverlays ) {
+		overlay->release();
+	}
+	mOverlays.clear();
+
+	// both threads call into the runtime
+	mHaptics.reset();
+	mFrameScheduler.stop();
+
 	if( mHMD ) {
 		vr::VR_Shutdown();
 		mHMD = nullptr;
@@ -158,10 +527,17 @@ HtcVive::~HtcVive()
 
 void hmd::HtcVive::update()
 {
+	// events stay queued in the runtime until the device cache may be touched again
+	if( ! isReady() ) {
+		pumpInitialization( false );
+		return;
+	}
+
 	vr::VREvent_t event;
 	while( mHMD->PollNextEvent( &event, sizeof(event) ) ) {
 		processVREvent( event );
 	}
+	pumpRenderModelDecodes();
 
 	// Process SteamVR controller state
 	for( vr::TrackedDeviceIndex_t unDevice = 0; unDevice < vr::k_unMaxTrackedDeviceCount; unDevice++ ) {
@@ -174,15 +550,36 @@ void hmd::HtcVive::update()
 
 void HtcVive::bind()
 {
+	if( ! isReady() )
+		return;
+
+	mGl.beginFrame();
 	updateHMDMatrixPose();
+	++mFrameIndex;
 }
 
 void hmd::HtcVive::unbind()
 {
-	vr::Texture_t leftEyeTexture = { (void*)leftEyeDesc.mResolveTexture->getId() , vr::API_OpenGL, vr::ColorSpace_Gamma };
-	vr::VRCompositor()->Submit( vr::Eye_Left, &leftEyeTexture );
-	vr::Texture_t rightEyeTexture = { (void*)rightEyeDesc.mResolveTexture->getId(), vr::API_OpenGL, vr::ColorSpace_Gamma };
-	vr::VRCompositor()->Submit( vr::Eye_Right, &rightEyeTexture );
+	if( ! isReady() )
+		return;
+
+	for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye ) {
+		auto texture = getEyeTexture( static_cast<vr::Hmd_Eye>( eye ) );
+		if( ! texture )
+			continue; // nothing rendered yet
+
+		const EyeSubmission& submission = mEyeSubmissions[eye];
+		bool external = hasExternalEyeTexture( static_cast<vr::Hmd_Eye>( eye ) );
+		vr::Texture_t eyeTexture = { (void*)texture->getId(), vr::API_OpenGL, external ? submission.colorSpace : vr::ColorSpace_Gamma };
+		mGl.submit( static_cast<vr::Hmd_Eye>( eye ), eyeTexture, external ? &submission.bounds : nullptr );
+	}
+
+	if( mFrameScheduler.isRunning() )
+		mFrameScheduler.frameSubmitted();
+
+	for( auto& overlay : mOverlays ) {
+		overlay->update();
+	}
 
 	// Spew out the controller and pose count whenever they change.
 	if( m_iTrackedControllerCount != m_iTrackedControllerCount_Last || m_iValidPoseCount != m_iValidPoseCount_Last )
@@ -194,60 +591,271 @@ void hmd::HtcVive::unbind()
 	}
 }
 
-void hmd::HtcVive::setupShaders()
+gl::Texture2dRef HtcVive::getEyeTexture( vr::Hmd_Eye nEye ) const
 {
-	mGlslLens = gl::GlslProg::create(
-		"#version 410 core\n"
-		"layout(location = 0) in vec4 position;\n"
-		"layout(location = 1) in vec2 v2UVredIn;\n"
-		"layout(location = 2) in vec2 v2UVGreenIn;\n"
-		"layout(location = 3) in vec2 v2UVblueIn;\n"
-		"noperspective  out vec2 v2UVred;\n"
-		"noperspective  out vec2 v2UVgreen;\n"
-		"noperspective  out vec2 v2UVblue;\n"
-		"void main()\n"
-		"{\n"
-		"	v2UVred = v2UVredIn;\n"
-		"	v2UVgreen = v2UVGreenIn;\n"
-		"	v2UVblue = v2UVblueIn;\n"
-		"	gl_Position = position;\n"
-		"}\n",
+	const EyeSubmission& submission = mEyeSubmissions[nEye];
+	if( submission.framebuffer )
+		return submission.framebuffer->getColorTexture();
+	if( submission.texture )
+		return submission.texture;
 
-		// fragment shader
-		"#version 410 core\n"
-		"uniform sampler2D mytexture;\n"
+	return mViews[nEye].framebuffer.mResolveTexture;
+}
 
-		"noperspective  in vec2 v2UVred;\n"
-		"noperspective  in vec2 v2UVgreen;\n"
-		"noperspective  in vec2 v2UVblue;\n"
+void HtcVive::setEyeTexture( vr::Hmd_Eye eye, const gl::Texture2dRef& texture, vr::EColorSpace colorSpace, const Rectf& bounds )
+{
+	EyeSubmission& submission = mEyeSubmissions[eye];
+	submission.texture = texture;
+	submission.framebuffer.reset();
+	submission.colorSpace = colorSpace;
+	submission.bounds.uMin = bounds.x1;
+	submission.bounds.vMin = bounds.y1;
+	submission.bounds.uMax = bounds.x2;
+	submission.bounds.vMax = bounds.y2;
+}
 
-		"out vec4 outputColor;\n"
+void HtcVive::setEyeFramebuffer( vr::Hmd_Eye eye, const gl::FboRef& framebuffer, vr::EColorSpace colorSpace, const Rectf& bounds )
+{
+	setEyeTexture( eye, nullptr, colorSpace, bounds );
+	mEyeSubmissions[eye].framebuffer = framebuffer;
+}
 
-		"void main()\n"
-		"{\n"
-		"	float fBoundsCheck = ( (dot( vec2( lessThan( v2UVgreen.xy, vec2(0.05, 0.05)) ), vec2(1.0, 1.0))+dot( vec2( greaterThan( v2UVgreen.xy, vec2( 0.95, 0.95)) ), vec2(1.0, 1.0))) );\n"
-		"	if( fBoundsCheck > 1.0 )\n"
-		"	{ outputColor = vec4( 0, 0, 0, 1.0 ); }\n"
-		"	else\n"
-		"	{\n"
-		"		float red = texture(mytexture, v2UVred).x;\n"
-		"		float green = texture(mytexture, v2UVgreen).y;\n"
-		"		float blue = texture(mytexture, v2UVblue).z;\n"
-		"		outputColor = vec4( red, green, blue, 1.0  ); }\n"
-		"}\n"
-		);
+void HtcVive::setPipelined( bool pipelined )
+{
+	if( pipelined )
+		mFrameScheduler.start();
+	else
+		mFrameScheduler.stop();
+}
+
+static const char *kLensVertexShader =
+	"#version 410 core\n"
+	"layout(location = 0) in vec4 position;\n"
+	"layout(location = 1) in vec2 v2UVredIn;\n"
+	"layout(location = 2) in vec2 v2UVGreenIn;\n"
+	"layout(location = 3) in vec2 v2UVblueIn;\n"
+	"noperspective  out vec2 v2UVred;\n"
+	"noperspective  out vec2 v2UVgreen;\n"
+	"noperspective  out vec2 v2UVblue;\n"
+	"void main()\n"
+	"{\n"
+	"	v2UVred = v2UVredIn;\n"
+	"	v2UVgreen = v2UVGreenIn;\n"
+	"	v2UVblue = v2UVblueIn;\n"
+	"	gl_Position = position;\n"
+	"}\n";
+
+static const char *kLensFragmentShader =
+	"#version 410 core\n"
+	"uniform sampler2D mytexture;\n"
+
+	"noperspective  in vec2 v2UVred;\n"
+	"noperspective  in vec2 v2UVgreen;\n"
+	"noperspective  in vec2 v2UVblue;\n"
+
+	"out vec4 outputColor;\n"
+
+	"void main()\n"
+	"{\n"
+	"	float fBoundsCheck = ( (dot( vec2( lessThan( v2UVgreen.xy, vec2(0.05, 0.05)) ), vec2(1.0, 1.0))+dot( vec2( greaterThan( v2UVgreen.xy, vec2( 0.95, 0.95)) ), vec2(1.0, 1.0))) );\n"
+	"	if( fBoundsCheck > 1.0 )\n"
+	"	{ outputColor = vec4( 0, 0, 0, 1.0 ); }\n"
+	"	else\n"
+	"	{\n"
+	"#ifdef GREEN_ONLY\n"
+	"		outputColor = vec4( texture(mytexture, v2UVgreen).rgb, 1.0 );\n"
+	"#else\n"
+	"		float red = texture(mytexture, v2UVred).x;\n"
+	"		float green = texture(mytexture, v2UVgreen).y;\n"
+	"		float blue = texture(mytexture, v2UVblue).z;\n"
+	"		outputColor = vec4( red, green, blue, 1.0  );\n"
+	"#endif\n"
+	"	}\n"
+	"}\n";
+
+// rasterizes the lens grid once to capture its interpolated coordinates and bounds check
+static const char *kLookupBakeFragmentShader =
+	"#version 410 core\n"
+	"noperspective  in vec2 v2UVred;\n"
+	"noperspective  in vec2 v2UVgreen;\n"
+	"noperspective  in vec2 v2UVblue;\n"
+	"layout(location = 0) out vec4 outGreenMask;\n"
+	"layout(location = 1) out vec4 outRedBlue;\n"
+	"void main()\n"
+	"{\n"
+	"	float fBoundsCheck = ( (dot( vec2( lessThan( v2UVgreen.xy, vec2(0.05, 0.05)) ), vec2(1.0, 1.0))+dot( vec2( greaterThan( v2UVgreen.xy, vec2( 0.95, 0.95)) ), vec2(1.0, 1.0))) );\n"
+	"	outGreenMask = vec4( v2UVgreen, fBoundsCheck > 1.0 ? 0.0 : 1.0, 0.0 );\n"
+	"	outRedBlue = vec4( v2UVred, v2UVblue );\n"
+	"}\n";
+
+static const char *kFullScreenVertexShader =
+	"#version 410 core\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 corner = vec2( ( gl_VertexID << 1 ) & 2, gl_VertexID & 2 );\n"
+	"	gl_Position = vec4( corner * 2.0 - 1.0, 0.0, 1.0 );\n"
+	"}\n";
+
+// shared by the mask and the reconstruction, so both agree on which pixels were skipped
+static const char *kDensityMaskFunction =
+	"uniform vec2 viewSize;\n"
+	"uniform vec2 lensCenter;\n"		// normalized device coordinates
+	"uniform float maskRadius;\n"
+	"uniform float maskStrength;\n"
+	"bool isMasked( ivec2 pixel )\n"
+	"{\n"
+	"	vec2 ndc = ( vec2( pixel ) + 0.5 ) / viewSize * 2.0 - 1.0;\n"
+	"	if( distance( ndc, lensCenter ) < maskRadius )\n"
+	"		return false;\n"
+	"	ivec2 quad = ( pixel >> 1 ) & 1;\n"
+	"	int rank = ( quad.x ^ quad.y ) * 2 + quad.y;\n"	// 2x2 ordered dither over quads
+	"	return ( float( rank ) + 0.5 ) / 4.0 < maskStrength;\n"
+	"}\n";
+
+static const char *kDensityMaskFragmentShader =
+	"out vec4 outputColor;\n"
+	"void main()\n"
+	"{\n"
+	"	if( ! isMasked( ivec2( gl_FragCoord.xy ) ) )\n"
+	"		discard;\n"
+	"	outputColor = vec4( 0.0 );\n"
+	"}\n";
+
+static const char *kDensityReconstructFragmentShader =
+	"uniform sampler2DMS renderTexture;\n"
+	"uniform int samples;\n"
+	"out vec4 outputColor;\n"
+	"vec4 resolve( ivec2 pixel )\n"
+	"{\n"
+	"	pixel = clamp( pixel, ivec2( 0 ), ivec2( viewSize ) - 1 );\n"
+	"	vec4 color = vec4( 0.0 );\n"
+	"	for( int i = 0; i < samples; ++i )\n"
+	"		color += texelFetch( renderTexture, pixel, i );\n"
+	"	return color / float( samples );\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"	ivec2 pixel = ivec2( gl_FragCoord.xy );\n"
+	"	if( ! isMasked( pixel ) ) {\n"
+	"		outputColor = resolve( pixel );\n"
+	"		return;\n"
+	"	}\n"
+	"	// same position in the neighboring quads; diagonals only when the pattern skipped all four\n"
+	"	const ivec2 offsets[8] = ivec2[8]( ivec2( 2, 0 ), ivec2( -2, 0 ), ivec2( 0, 2 ), ivec2( 0, -2 ), ivec2( 2, 2 ), ivec2( -2, 2 ), ivec2( 2, -2 ), ivec2( -2, -2 ) );\n"
+	"	vec4 sum = vec4( 0.0 );\n"
+	"	float count = 0.0;\n"
+	"	for( int i = 0; i < 8; ++i ) {\n"
+	"		if( i == 4 && count > 0.0 )\n"
+	"			break;\n"
+	"		if( ! isMasked( pixel + offsets[i] ) ) {\n"
+	"			sum += resolve( pixel + offsets[i] );\n"
+	"			count += 1.0;\n"
+	"		}\n"
+	"	}\n"
+	"	outputColor = count > 0.0 ? sum / count : resolve( pixel );\n"
+	"}\n";
+
+// reprojects the far field at infinity, the eye's offset from the center camera is below a pixel there
+static const char *kFarFieldCompositeFragmentShader =
+	"#version 410 core\n"
+	"uniform sampler2D farField;\n"
+	"uniform vec2 viewSize;\n"
+	"uniform mat4 eyeToFarField;\n"	// eye clip space to far field clip space, without the translation between them
+	"out vec4 outputColor;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 ndc = gl_FragCoord.xy / viewSize * 2.0 - 1.0;\n"
+	"	vec4 clip = eyeToFarField * vec4( ndc, 1.0, 1.0 );\n"
+	"	outputColor = texture( farField, clip.xy / clip.w * 0.5 + 0.5 );\n"
+	"}\n";
+
+static const char *kLookupFragmentShader =
+	"#version 410 core\n"
+	"uniform sampler2D eyeTexture;\n"
+	"uniform sampler2D lookupGreenMask;\n"
+	"uniform sampler2D lookupRedBlue;\n"
+	"out vec4 outputColor;\n"
+	"void main()\n"
+	"{\n"
+	"	ivec2 pixel = ivec2( gl_FragCoord.xy );\n"
+	"	vec4 greenMask = texelFetch( lookupGreenMask, pixel, 0 );\n"
+	"#ifdef GREEN_ONLY\n"
+	"	vec3 color = texture( eyeTexture, greenMask.xy ).rgb;\n"
+	"#else\n"
+	"	vec4 redBlue = texelFetch( lookupRedBlue, pixel, 0 );\n"
+	"	vec3 color = vec3( texture( eyeTexture, redBlue.xy ).x, texture( eyeTexture, greenMask.xy ).y, texture( eyeTexture, redBlue.zw ).z );\n"
+	"#endif\n"
+	"	outputColor = vec4( color * greenMask.z, 1.0 );\n"
+	"}\n";
+
+static const char *kLookupComputeShader =
+	"#version 430 core\n"
+	"layout( local_size_x = 8, local_size_y = 8 ) in;\n"
+	"layout( binding = 0 ) uniform sampler2D leftEye;\n"
+	"layout( binding = 1 ) uniform sampler2D rightEye;\n"
+	"layout( binding = 2 ) uniform sampler2D lookupGreenMask;\n"
+	"layout( binding = 3 ) uniform sampler2D lookupRedBlue;\n"
+	"layout( binding = 0, rgba8 ) uniform writeonly image2D target;\n"
+	"vec4 fetchEye( bool right, vec2 uv )\n"
+	"{\n"
+	"	return right ? textureLod( rightEye, uv, 0.0 ) : textureLod( leftEye, uv, 0.0 );\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"	ivec2 pixel = ivec2( gl_GlobalInvocationID.xy );\n"
+	"	ivec2 size = imageSize( target );\n"
+	"	if( any( greaterThanEqual( pixel, size ) ) )\n"
+	"		return;\n"
+	"	bool right = pixel.x >= size.x / 2;\n"
+	"	vec4 greenMask = texelFetch( lookupGreenMask, pixel, 0 );\n"
+	"#ifdef GREEN_ONLY\n"
+	"	vec3 color = fetchEye( right, greenMask.xy ).rgb;\n"
+	"#else\n"
+	"	vec4 redBlue = texelFetch( lookupRedBlue, pixel, 0 );\n"
+	"	vec3 color = vec3( fetchEye( right, redBlue.xy ).x, fetchEye( right, greenMask.xy ).y, fetchEye( right, redBlue.zw ).z );\n"
+	"#endif\n"
+	"	imageStore( target, pixel, vec4( color * greenMask.z, 1.0 ) );\n"
+	"}\n";
+
+//! Inserts \a define after the #version line of \a source.
+static std::string addDefine( const char *source, const char *define )
+{
+	std::string result{ source };
+	if( define )
+		result.insert( result.find( '\n' ) + 1, std::string( "#define " ) + define + "\n" );
+	return result;
+}
 
-	mGlslModel = ci::gl::GlslProg::create(
+static void setSamplerUnit( GLuint program, const char *name, GLint unit )
+{
+	GLint location = glGetUniformLocation( program, name );
+	if( location >= 0 )
+		glProgramUniform1i( program, location, unit );
+}
+
+void hmd::HtcVive::setupShaders()
+{
+	// raw handles, Cinder's GlslProg can't be created from a program binary; other distortion variants are created on first use
+	mDistortionPrograms[DISTORTION_MESH][DISTORTION_QUALITY_FULL] = mProgramCache.createProgram( kLensVertexShader, kLensFragmentShader );
+	if( ! mDistortionPrograms[DISTORTION_MESH][DISTORTION_QUALITY_FULL] ) {
+		throw ViveExeption{ "Unable to create the lens distortion program." };
+	}
+
+	mModelProgram = mProgramCache.createProgram(
 		"#version 410\n"
 		"uniform mat4	ciModelViewProjection;\n"
-		"in vec4		ciPosition;\n"
-		"in vec3		ciNormal;\n"
-		"in vec2		ciTexCoord0;\n"
+		"uniform vec3	positionScale;\n"
+		"uniform vec3	positionOffset;\n"
+		"uniform vec2	texCoordScale;\n"
+		"uniform vec2	texCoordOffset;\n"
+		"in vec4		ciPosition;\n"	// snorm16, bounding box relative
+		"in vec4		ciNormal;\n"		// snorm 10:10:10:2
+		"in vec2		ciTexCoord0;\n"	// unorm16, texture coordinate range relative
 		"out vec2		vTexCoord;\n"
 		"void main()\n"
 		"{\n"
-		"	vTexCoord = ciTexCoord0;\n"
-		"	gl_Position = ciModelViewProjection * vec4(ciPosition.xyz, 1);\n"
+		"	vTexCoord = ciTexCoord0 * texCoordScale + texCoordOffset;\n"
+		"	gl_Position = ciModelViewProjection * vec4(ciPosition.xyz * positionScale + positionOffset, 1);\n"
 		"}\n"
 		,
 		"#version 410\n"
@@ -258,57 +866,111 @@ void hmd::HtcVive::setupShaders()
 		"{\n"
 		"   outputColor = texture( diffuse, vTexCoord );\n"
 		"}\n" );
+	if( ! mModelProgram ) {
+		throw ViveExeption{ "Unable to create the render model program." };
+	}
 }
 
 
-bool CreateFrameBuffer( int nWidth, int nHeight, FramebufferDesc &framebufferDesc )
+static bool CreateFrameBuffer( int nWidth, int nHeight, FramebufferDesc &framebufferDesc, bool directStateAccess )
 {
-	glGenFramebuffers( 1, &framebufferDesc.m_nRenderFramebufferId );
-	glBindFramebuffer( GL_FRAMEBUFFER, framebufferDesc.m_nRenderFramebufferId );
-
-	glGenRenderbuffers( 1, &framebufferDesc.m_nDepthBufferId );
-	glBindRenderbuffer( GL_RENDERBUFFER, framebufferDesc.m_nDepthBufferId );
-	glRenderbufferStorageMultisample( GL_RENDERBUFFER, 4, GL_DEPTH_COMPONENT, nWidth, nHeight );
-	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, framebufferDesc.m_nDepthBufferId );
-
-	glGenTextures( 1, &framebufferDesc.m_nRenderTextureId );
-	glBindTexture( GL_TEXTURE_2D_MULTISAMPLE, framebufferDesc.m_nRenderTextureId );
-	glTexImage2DMultisample( GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGBA8, nWidth, nHeight, true );
-	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, framebufferDesc.m_nRenderTextureId, 0 );
-
-	glGenFramebuffers( 1, &framebufferDesc.m_nResolveFramebufferId );
-	glBindFramebuffer( GL_FRAMEBUFFER, framebufferDesc.m_nResolveFramebufferId );
-
 	gl::Texture2d::Format fmt;
 	fmt.dataType(GL_UNSIGNED_BYTE).internalFormat(GL_RGBA8);
 	fmt.minFilter(GL_LINEAR).magFilter(GL_LINEAR_MIPMAP_LINEAR);
 	fmt.wrap(GL_CLAMP_TO_EDGE);
 	framebufferDesc.mResolveTexture = gl::Texture2d::create(nWidth, nHeight, fmt);
-	framebufferDesc.mResolveTexture->bind();
-	
-	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, framebufferDesc.mResolveTexture->getId(), 0 );
 
+#if CINDER_VIVE_GL_DSA
+	if( directStateAccess ) {
+		glCreateFramebuffers( 1, &framebufferDesc.m_nRenderFramebufferId );
 
-	// check FBO status
-	GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
-	if( status != GL_FRAMEBUFFER_COMPLETE )
+		glCreateRenderbuffers( 1, &framebufferDesc.m_nDepthBufferId );
+		glNamedRenderbufferStorageMultisample( framebufferDesc.m_nDepthBufferId, 4, GL_DEPTH24_STENCIL8, nWidth, nHeight );
+		glNamedFramebufferRenderbuffer( framebufferDesc.m_nRenderFramebufferId, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, framebufferDesc.m_nDepthBufferId );
+
+		glCreateTextures( GL_TEXTURE_2D_MULTISAMPLE, 1, &framebufferDesc.m_nRenderTextureId );
+		glTextureStorage2DMultisample( framebufferDesc.m_nRenderTextureId, 4, GL_RGBA8, nWidth, nHeight, GL_TRUE );
+		glNamedFramebufferTexture( framebufferDesc.m_nRenderFramebufferId, GL_COLOR_ATTACHMENT0, framebufferDesc.m_nRenderTextureId, 0 );
+
+		glCreateFramebuffers( 1, &framebufferDesc.m_nResolveFramebufferId );
+		glNamedFramebufferTexture( framebufferDesc.m_nResolveFramebufferId, GL_COLOR_ATTACHMENT0, framebufferDesc.mResolveTexture->getId(), 0 );
+
+		return glCheckNamedFramebufferStatus( framebufferDesc.m_nRenderFramebufferId, GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE
+			&& glCheckNamedFramebufferStatus( framebufferDesc.m_nResolveFramebufferId, GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+	}
+#endif
+
+	// bind-to-edit path; bindings go through Cinder's scoped helpers so its state cache stays valid
+	bool complete = true;
+
+	glGenFramebuffers( 1, &framebufferDesc.m_nRenderFramebufferId );
 	{
-		return false;
+		gl::ScopedFramebuffer scopedFbo{ GL_FRAMEBUFFER, framebufferDesc.m_nRenderFramebufferId };
+
+		glGenRenderbuffers( 1, &framebufferDesc.m_nDepthBufferId );
+		{
+			gl::ScopedRenderbuffer scopedRb{ GL_RENDERBUFFER, framebufferDesc.m_nDepthBufferId };
+			glRenderbufferStorageMultisample( GL_RENDERBUFFER, 4, GL_DEPTH24_STENCIL8, nWidth, nHeight );
+		}
+		glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, framebufferDesc.m_nDepthBufferId );
+
+		glGenTextures( 1, &framebufferDesc.m_nRenderTextureId );
+		{
+			gl::ScopedTextureBind scopedTex{ GL_TEXTURE_2D_MULTISAMPLE, framebufferDesc.m_nRenderTextureId };
+			glTexImage2DMultisample( GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGBA8, nWidth, nHeight, true );
+		}
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, framebufferDesc.m_nRenderTextureId, 0 );
+
+		complete = complete && glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
 	}
 
-	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	glGenFramebuffers( 1, &framebufferDesc.m_nResolveFramebufferId );
+	{
+		gl::ScopedFramebuffer scopedFbo{ GL_FRAMEBUFFER, framebufferDesc.m_nResolveFramebufferId };
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, framebufferDesc.mResolveTexture->getId(), 0 );
 
-	return true;
+		complete = complete && glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+	}
+
+	return complete;
 }
 
 void HtcVive::setupStereoRenderTargets()
 {
+	// the targets themselves are created on first render, apps submitting their own textures never need them
 	mHMD->GetRecommendedRenderTargetSize( &mRenderSize.x, &mRenderSize.y );
-	CreateFrameBuffer( mRenderSize.x, mRenderSize.y, leftEyeDesc );
-	CreateFrameBuffer( mRenderSize.x, mRenderSize.y, rightEyeDesc );
+	for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye ) {
+		mViews[eye].size = mRenderSize;
+	}
+	updateDensityMaskCoverage();
 }
 
-void HtcVive::setupDistortion()
+void HtcVive::ensureViewFramebuffer( ViewId view )
+{
+	ViewState& state = mViews[view];
+	if( state.framebuffer.m_nRenderFramebufferId )
+		return;
+
+	if( ! CreateFrameBuffer( state.size.x, state.size.y, state.framebuffer, mGl.hasDirectStateAccess() ) ) {
+		CI_LOG_E( "Incomplete framebuffer for view " << view << "." );
+	}
+}
+
+HtcVive::ViewId HtcVive::addView( const ViewFormat& format )
+{
+	ViewState view;
+	view.size = format.getSize();
+	view.projection = format.getProjection();
+	view.device = format.getDevice();
+	view.deviceToView = glm::inverse( format.getDeviceToCamera() );
+	view.updateDivisor = format.getUpdateDivisor();
+
+	mViews.push_back( view );
+	mViewDrawLists.resize( mViews.size() );
+	return mViews.size() - 1;
+}
+
+void HtcVive::buildDistortion()
 {
 	GLushort m_iLensGridSegmentCountH = 43;
 	GLushort m_iLensGridSegmentCountV = 43;
@@ -318,7 +980,8 @@ void HtcVive::setupDistortion()
 
 	float u, v = 0;
 
-	std::vector<VertexDataLens> vVerts( 0 );
+	std::vector<VertexDataLens>& vVerts = mLensVertices;
+	vVerts.clear();
 	VertexDataLens vert;
 
 	//left eye distortion verts
@@ -359,7 +1022,8 @@ void HtcVive::setupDistortion()
 		}
 	}
 
-	std::vector<GLushort> vIndices;
+	std::vector<GLushort>& vIndices = mLensIndices;
+	vIndices.clear();
 	GLushort a, b, c, d;
 
 	GLushort offset = 0;
@@ -401,52 +1065,63 @@ void HtcVive::setupDistortion()
 	}
 	m_uiIndexSize = vIndices.size();
 
-	glGenVertexArrays( 1, &m_unLensVAO );
-	glBindVertexArray( m_unLensVAO );
-
-	glGenBuffers( 1, &m_glIDVertBuffer );
-	glBindBuffer( GL_ARRAY_BUFFER, m_glIDVertBuffer );
-	glBufferData( GL_ARRAY_BUFFER, vVerts.size()*sizeof( VertexDataLens ), &vVerts[0], GL_STATIC_DRAW );
-
-	glGenBuffers( 1, &m_glIDIndexBuffer );
-	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, m_glIDIndexBuffer );
-	glBufferData( GL_ELEMENT_ARRAY_BUFFER, vIndices.size()*sizeof( GLushort ), &vIndices[0], GL_STATIC_DRAW );
-
-	glEnableVertexAttribArray( 0 );
-	glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, sizeof( VertexDataLens ), (void *)offsetof( VertexDataLens, position ) );
+	if( mUploads ) {
+		mLensVboUpload = mUploads->uploadBuffer( GL_ARRAY_BUFFER, vVerts );
+		mLensIboUpload = mUploads->uploadBuffer( GL_ELEMENT_ARRAY_BUFFER, vIndices );
+	}
+}
 
-	glEnableVertexAttribArray( 1 );
-	glVertexAttribPointer( 1, 2, GL_FLOAT, GL_FALSE, sizeof( VertexDataLens ), (void *)offsetof( VertexDataLens, texCoordRed ) );
+void HtcVive::setupDistortion()
+{
+	if( mLensVboUpload.valid() ) {
+		mLensVbo = mLensVboUpload.get();
+		mLensIbo = mLensIboUpload.get();
+		mLensVboUpload = std::shared_future<gl::VboRef>();
+		mLensIboUpload = std::shared_future<gl::VboRef>();
+	}
+	else {
+		mLensVbo = gl::Vbo::create( GL_ARRAY_BUFFER, mLensVertices.size()*sizeof( VertexDataLens ), mLensVertices.data(), GL_STATIC_DRAW );
+		mLensIbo = gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, mLensIndices.size()*sizeof( GLushort ), mLensIndices.data(), GL_STATIC_DRAW );
+		mGl.recordBufferUpload( mLensVbo->getSize() );
+		mGl.recordBufferUpload( mLensIbo->getSize() );
+	}
+	std::vector<VertexDataLens>().swap( mLensVertices );
+	std::vector<GLushort>().swap( mLensIndices );
 
-	glEnableVertexAttribArray( 2 );
-	glVertexAttribPointer( 2, 2, GL_FLOAT, GL_FALSE, sizeof( VertexDataLens ), (void *)offsetof( VertexDataLens, texCoordGreen ) );
+	mEmptyVao = gl::Vao::create();
+	mLensVao = gl::Vao::create();
+	gl::ScopedVao scopedVao{ mLensVao };
+	gl::ScopedBuffer scopedVbo{ mLensVbo };
+	mLensIbo->bind();
 
-	glEnableVertexAttribArray( 3 );
-	glVertexAttribPointer( 3, 2, GL_FLOAT, GL_FALSE, sizeof( VertexDataLens ), (void *)offsetof( VertexDataLens, texCoordBlue ) );
+	gl::enableVertexAttribArray( 0 );
+	gl::vertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, sizeof( VertexDataLens ), (void *)offsetof( VertexDataLens, position ) );
 
-	glBindVertexArray( 0 );
+	gl::enableVertexAttribArray( 1 );
+	gl::vertexAttribPointer( 1, 2, GL_FLOAT, GL_FALSE, sizeof( VertexDataLens ), (void *)offsetof( VertexDataLens, texCoordRed ) );
 
-	glDisableVertexAttribArray( 0 );
-	glDisableVertexAttribArray( 1 );
-	glDisableVertexAttribArray( 2 );
-	glDisableVertexAttribArray( 3 );
+	gl::enableVertexAttribArray( 2 );
+	gl::vertexAttribPointer( 2, 2, GL_FLOAT, GL_FALSE, sizeof( VertexDataLens ), (void *)offsetof( VertexDataLens, texCoordGreen ) );
 
-	glBindBuffer( GL_ARRAY_BUFFER, 0 );
-	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+	gl::enableVertexAttribArray( 3 );
+	gl::vertexAttribPointer( 3, 2, GL_FLOAT, GL_FALSE, sizeof( VertexDataLens ), (void *)offsetof( VertexDataLens, texCoordBlue ) );
 }
 
 void HtcVive::setupCameras()
 {
-	m_mat4ProjectionLeft = getHMDMatrixProjectionEye( vr::Eye_Left );
-	m_mat4ProjectionRight = getHMDMatrixProjectionEye( vr::Eye_Right );
-	m_mat4eyePosLeft = getHMDMatrixPoseEye( vr::Eye_Left );
-	m_mat4eyePosRight = getHMDMatrixPoseEye( vr::Eye_Right );
+	for( int i = vr::Eye_Left; i <= vr::Eye_Right; ++i ) {
+		auto eye = static_cast<vr::Hmd_Eye>( i );
+		mViews[eye].projection = getHMDMatrixProjectionEye( eye );
+		mViews[eye].device = vr::k_unTrackedDeviceIndex_Hmd;
+		mViews[eye].deviceToView = getHMDMatrixPoseEye( eye );
+		mViews[eye].updateDivisor = 1;
+	}
 }
 
 void HtcVive::setupRenderModels()
 {
 	for( auto id = vr::k_unTrackedDeviceIndex_Hmd + 1; id < vr::k_unMaxTrackedDeviceCount; id++ ) {
-		if( !mHMD->IsTrackedDeviceConnected( id ) )
+		if( !mDeviceProperties.get( id ).isConnected )
 			continue;
 
 		setupRenderModelForTrackedDevice( id );
@@ -458,11 +1133,21 @@ void HtcVive::setupRenderModelForTrackedDevice( vr::TrackedDeviceIndex_t unTrack
 	if( unTrackedDeviceIndex >= vr::k_unMaxTrackedDeviceCount )
 		return;
 
-	// try to find a model we've already set up
-	std::string sRenderModelName = GetTrackedDeviceString( mHMD, unTrackedDeviceIndex, vr::Prop_RenderModelName_String );
-	auto renderModel = findOrLoadRenderModel( sRenderModelName );
+	// the device may have been re-activated with a different model
+	releaseRenderModelForTrackedDevice( unTrackedDeviceIndex );
+
+	const std::string& sRenderModelName = mDeviceProperties.getRenderModelName( unTrackedDeviceIndex );
+	// acquiring a model that is neither resident nor decoded would block on the runtime, so it's
+	// decoded on the job pool first and the device isn't drawn until pumpRenderModelDecodes() returns here
+	if( ! mRenderModels.isResident( sRenderModelName ) && ! mDecodedRenderModels.count( sRenderModelName ) ) {
+		mPendingRenderModels[unTrackedDeviceIndex] = sRenderModelName;
+		requestRenderModelDecode( sRenderModelName );
+		return;
+	}
+
+	auto renderModel = mRenderModels.acquire( sRenderModelName );
 	if( !renderModel ) {
-		std::string sTrackingSystemName = GetTrackedDeviceString( mHMD, unTrackedDeviceIndex, vr::Prop_TrackingSystemName_String );
+		const std::string& sTrackingSystemName = mDeviceProperties.getTrackingSystemName( unTrackedDeviceIndex );
 		CI_LOG_E( "Unable to load render model for tracked device " << unTrackedDeviceIndex << " " << sTrackingSystemName << " " << sRenderModelName );
 	}
 	else {
@@ -471,6 +1156,21 @@ void HtcVive::setupRenderModelForTrackedDevice( vr::TrackedDeviceIndex_t unTrack
 	}
 }
 
+void HtcVive::releaseRenderModelForTrackedDevice( vr::TrackedDeviceIndex_t unTrackedDeviceIndex )
+{
+	if( unTrackedDeviceIndex >= vr::k_unMaxTrackedDeviceCount )
+		return;
+
+	// a decode still in flight is kept for the next device using the model
+	mPendingRenderModels[unTrackedDeviceIndex].clear();
+	if( ! mTrackedDeviceToRenderModel[unTrackedDeviceIndex] )
+		return;
+
+	mRenderModels.release( mTrackedDeviceToRenderModel[unTrackedDeviceIndex]->GetName() );
+	mTrackedDeviceToRenderModel[unTrackedDeviceIndex].reset();
+	mShowTrackedDevice[unTrackedDeviceIndex] = false;
+}
+
 void hmd::HtcVive::setupCompositor()
 {
 	if( !vr::VRCompositor() ) {
@@ -480,6 +1180,9 @@ void hmd::HtcVive::setupCompositor()
 
 void hmd::HtcVive::renderController( const vr::Hmd_Eye& eye )
 {
+	if( ! isReady() )
+		return;
+
 	bool inputCapturedByAnotherProcess = mHMD->IsInputFocusCapturedByAnotherProcess();
 
 	for( uint32_t i = 0; i < vr::k_unMaxTrackedDeviceCount; i++ )
@@ -491,7 +1194,7 @@ void hmd::HtcVive::renderController( const vr::Hmd_Eye& eye )
 		if( !pose.bPoseIsValid )
 			continue;
 
-		if( inputCapturedByAnotherProcess && mHMD->GetTrackedDeviceClass( i ) == vr::TrackedDeviceClass_Controller )
+		if( inputCapturedByAnotherProcess && mDeviceProperties.getDeviceClass( i ) == vr::TrackedDeviceClass_Controller )
 			continue;
 
 		if (i == mDeviceIndexLeft || i == mDeviceIndexRight) // uncomment this to also see the lighthouse cameras etc.
@@ -501,22 +1204,28 @@ void hmd::HtcVive::renderController( const vr::Hmd_Eye& eye )
 			gl::drawCoordinateFrame( 0.3f, 0.06f, 0.01f );
 		}
 
-		//mTrackedDeviceToRenderModel[i]->draw(); //TODO: Fix render!
+		//mTrackedDeviceToRenderModel[i]->draw( mGl ); //TODO: Fix render!
 	}
 }
 
 void HtcVive::processVREvent( const vr::VREvent_t & event )
 {
+	mDeviceProperties.handleEvent( event );
+	mChaperone.handleEvent( event );
+
 	switch( event.eventType ) {
 	case vr::VREvent_TrackedDeviceActivated:
 	{
 		CI_LOG_I( "Device " << event.trackedDeviceIndex << " attached. Setting up render model." );
+		if( event.trackedDeviceIndex < vr::k_unMaxTrackedDeviceCount )
+			m_rDevClassChar[event.trackedDeviceIndex] = 0;
 		setupRenderModelForTrackedDevice( event.trackedDeviceIndex );
 	}
 	break;
 	case vr::VREvent_TrackedDeviceDeactivated:
 	{
 		CI_LOG_I( "Device " << event.trackedDeviceIndex << " detached." );
+		releaseRenderModelForTrackedDevice( event.trackedDeviceIndex );
 	}
 	break;
 	case vr::VREvent_TrackedDeviceUpdated:
@@ -525,95 +1234,814 @@ void HtcVive::processVREvent( const vr::VREvent_t & event )
 	}
 	break;
 	default:
-		CI_LOG_I("VR Event " << event.eventType << " happened.");
+		break;
 	}
+
+	mEvents.dispatch( event );
 }
 
 void hmd::HtcVive::renderStereoTargets( std::function<void( vr::Hmd_Eye )> renderScene, const glm::mat4& worldPose )
 {
-	glEnable( GL_MULTISAMPLE );
+	if( ! isReady() )
+		return;
 
-	// Left Eye
-	glBindFramebuffer( GL_FRAMEBUFFER, leftEyeDesc.m_nRenderFramebufferId );
-	glViewport( 0, 0, mRenderSize.x, mRenderSize.y );
-	{
-		gl::ScopedViewMatrix pushView;
-		gl::ScopedProjectionMatrix pushProj;
-		gl::setViewMatrix( m_mat4eyePosLeft * m_mat4HMDPose * worldPose);
-		gl::setProjectionMatrix( m_mat4ProjectionLeft );
-		renderScene( vr::Eye_Left );
-		//gl::setViewMatrix(m_mat4eyePosLeft * m_mat4HMDPose);
-		//renderController( vr::Eye_Left );
+	beginFrame( worldPose );
+
+	beginStereoPass();
+	renderView( vr::Eye_Left, [&] { renderScene( vr::Eye_Left ); } );
+	renderView( vr::Eye_Right, [&] { renderScene( vr::Eye_Right ); } );
+	endStereoPass();
+}
+
+void hmd::HtcVive::renderStereoTargets( const PrepareFrameFn& prepareFrame, const PrepareEyeFn& prepareEye, const glm::mat4& worldPose )
+{
+	if( ! isReady() )
+		return;
+
+	beginFrame( worldPose );
+
+	renderPreparedViews( prepareFrame, [&prepareEye]( ViewId view, const FrameState& frame, DrawList& drawList ) {
+		prepareEye( static_cast<vr::Hmd_Eye>( view ), frame, drawList );
+	}, 2 );
+}
+
+void HtcVive::renderHybridStereoTargets( const RenderFarFieldFn& renderFarField, const std::function<void( vr::Hmd_Eye )>& renderNearField, const glm::mat4& worldPose )
+{
+	if( ! isReady() )
+		return;
+
+	// the eyes stop at the split when the far field is composited behind them, and span it all otherwise
+	bool hybrid = mFarFieldEnabled && ensureFarFieldProgram();
+	beginFrame( worldPose, hybrid ? mFarFieldSplit : mFarFieldFarClip );
+	// the pre-stereo callback may have switched it off and released the pass
+	hybrid = hybrid && mFarFieldEnabled;
+	if( hybrid )
+		renderFarFieldPass( renderFarField );
+
+	beginStereoPass();
+	for( int i = vr::Eye_Left; i <= vr::Eye_Right; ++i ) {
+		auto eye = static_cast<vr::Hmd_Eye>( i );
+		const FrameView& frameView = mFrameState.views[eye];
+		if( hybrid ) {
+			renderView( eye, [&] {
+				compositeFarField( eye );
+				renderNearField( eye );
+			} );
+		}
+		else {
+			renderView( eye, [&] {
+				renderFarField( frameView );
+				renderNearField( eye );
+			} );
+		}
 	}
-	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	endStereoPass();
+}
 
-	glDisable( GL_MULTISAMPLE );
+void HtcVive::renderViews( const RenderViewFn& renderScene, const glm::mat4& worldPose )
+{
+	if( ! isReady() )
+		return;
 
-	glBindFramebuffer( GL_READ_FRAMEBUFFER, leftEyeDesc.m_nRenderFramebufferId );
-	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, leftEyeDesc.m_nResolveFramebufferId );
+	beginFrame( worldPose );
 
-	glBlitFramebuffer( 0, 0, mRenderSize.x, mRenderSize.y, 0, 0, mRenderSize.x, mRenderSize.y,
-		GL_COLOR_BUFFER_BIT,
-		GL_LINEAR );
+	beginStereoPass();
+	for( ViewId view = 0; view < mViews.size(); ++view ) {
+		const FrameView& frameView = mFrameState.views[view];
+		if( frameView.active )
+			renderView( view, [&] { renderScene( view, frameView ); } );
+	}
+	endStereoPass();
+}
+
+void HtcVive::renderViews( const PrepareFrameFn& prepareFrame, const PrepareViewFn& prepareView, const glm::mat4& worldPose )
+{
+	if( ! isReady() )
+		return;
+
+	beginFrame( worldPose );
+	renderPreparedViews( prepareFrame, prepareView, mViews.size() );
+}
+
+void HtcVive::renderPreparedViews( const PrepareFrameFn& prepareFrame, const PrepareViewFn& prepareView, ViewId viewCount )
+{
+	// Shared culling and preparation runs once, however many views are due this frame.
+	if( prepareFrame )
+		prepareFrame( mFrameState );
+
+	// Record the due views in parallel; earlier views are submitted while later ones may still be preparing.
+	auto& pool = getJobPool();
+	mViewJobs.resize( viewCount );
+	for( ViewId view = 0; view < viewCount; ++view ) {
+		if( ! mFrameState.views[view].active ) {
+			mViewJobs[view] = std::future<void>();
+			continue;
+		}
+
+		mViewDrawLists[view].clear();
+		mViewJobs[view] = pool.enqueue( [this, &prepareView, view] { prepareView( view, mFrameState, mViewDrawLists[view] ); } );
+	}
+
+	// After a failure the remaining jobs still reference prepareView and the draw lists, so every one is
+	// waited on and the pass closed before the first exception is rethrown.
+	std::exception_ptr error;
+	beginStereoPass();
+	for( ViewId view = 0; view < viewCount; ++view ) {
+		if( ! mViewJobs[view].valid() )
+			continue;
+
+		try {
+			mViewJobs[view].get();
+			if( ! error )
+				renderView( view, [&] { mViewDrawLists[view].execute(); } );
+		}
+		catch( ... ) {
+			if( ! error )
+				error = std::current_exception();
+		}
+	}
+	endStereoPass();
+
+	if( error )
+		std::rethrow_exception( error );
+}
+
+OverlayRef HtcVive::createOverlay( const std::string& key, const std::string& name, const glm::ivec2& size, const Overlay::RenderFn& renderFn )
+{
+	OverlayRef overlay{ new Overlay{ key, name, size } };
+	overlay->setRenderFn( renderFn );
+	mOverlays.push_back( overlay );
+	return overlay;
+}
+
+void HtcVive::destroyOverlay( const OverlayRef& overlay )
+{
+	if( ! overlay )
+		return;
+
+	overlay->release();
+	mOverlays.erase( std::remove( mOverlays.begin(), mOverlays.end(), overlay ), mOverlays.end() );
+}
+
+JobPool& HtcVive::getJobPool()
+{
+	if( ! mJobPool )
+		mJobPool.reset( new JobPool );
+	return *mJobPool;
+}
+
+UploadService& HtcVive::getUploadService()
+{
+	if( ! mUploads )
+		mUploads.reset( new UploadService );
+	return *mUploads;
+}
+
+HapticEngine& HtcVive::getHaptics()
+{
+	if( ! mHaptics )
+		mHaptics.reset( new HapticEngine{ mHMD } );
+	return *mHaptics;
+}
+
+bool HtcVive::playHapticWaveform( vr::Hmd_Eye nEye, const HapticWaveform& waveform )
+{
+	int index = mHandControllerState[nEye].index;
+	if( index < 0 )
+		return false;
+
+	return getHaptics().play( index, waveform );
+}
+
+void HtcVive::updateFrameState( const glm::mat4& worldPose )
+{
+	mFrameState.frameIndex = mFrameIndex;
+	mFrameState.renderSize = mRenderSize;
+	mFrameState.worldPose = worldPose;
+	mFrameState.hmdPose = m_mat4HMDPose;
+	mFrameState.views.resize( mViews.size() );
+
+	for( ViewId id = 0; id < mViews.size(); ++id ) {
+		const ViewState& view = mViews[id];
+		FrameView& frameView = mFrameState.views[id];
+
+		// fixed cameras keep their tracking space pose in deviceToView
+		glm::mat4 trackingToDevice;
+		if( view.device == vr::k_unTrackedDeviceIndex_Hmd )
+			trackingToDevice = m_mat4HMDPose;
+		else if( view.device < vr::k_unMaxTrackedDeviceCount )
+			trackingToDevice = glm::inverse( mDevicePose[view.device] );
+
+		frameView.view = view.deviceToView * trackingToDevice * worldPose;
+		frameView.projection = view.projection;
+		frameView.size = view.size;
+
+		// staggered by id so views sharing a divisor don't all land on the same headset frame
+		bool due = ( mFrameIndex + id ) % view.updateDivisor == 0;
+		bool tracked = view.device >= vr::k_unMaxTrackedDeviceCount || mTrackedDevicePose[view.device].bPoseIsValid;
+		frameView.active = due && tracked;
+	}
 
-	glBindFramebuffer( GL_READ_FRAMEBUFFER, 0 );
-	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+	// the eyes are never skipped, the compositor expects both every frame
+	mFrameState.views[vr::Eye_Left].active = true;
+	mFrameState.views[vr::Eye_Right].active = true;
+}
+
+void HtcVive::beginFrame( const glm::mat4& worldPose, float eyeFarClip )
+{
+	updateFrameState( worldPose );
+	if( eyeFarClip > 0 ) {
+		for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye )
+			mFrameState.views[eye].projection = getProjectionEye( static_cast<vr::Hmd_Eye>( eye ), m_fNearClip, eyeFarClip );
+	}
 
-	glEnable( GL_MULTISAMPLE );
+	const ViewState& left = mViews[vr::Eye_Left];
+	const ViewState& right = mViews[vr::Eye_Right];
+	float farClip = eyeFarClip > 0 ? eyeFarClip : m_fFarClip;
+	mFrameContext.beginFrame( mFrameState, makeSharedFrustum( m_mat4HMDPose * worldPose, left.projection, left.deviceToView, right.projection, right.deviceToView, m_fNearClip, farClip ) );
+	if( mFarFieldEnabled )
+		updateFarFieldView();
+
+	if( mPreStereoFn )
+		mPreStereoFn( mFrameContext );
+}
+
+void HtcVive::beginStereoPass()
+{
+	mPrevReadFramebuffer = mGl.getFramebuffer( GL_READ_FRAMEBUFFER );
+	mPrevDrawFramebuffer = mGl.getFramebuffer( GL_DRAW_FRAMEBUFFER );
+	mPrevViewport = mGl.getViewport();
+	mPrevMultisample = mGl.isEnabled( GL_MULTISAMPLE );
+	// the app ran since the last pass
+	mGl.forgetRawProgram();
+
+	// GL_MULTISAMPLE only affects rasterization, so it can stay on across the resolve blits
+	mGl.enable( GL_MULTISAMPLE );
+}
+
+void HtcVive::endStereoPass()
+{
+	if( mPrevReadFramebuffer == mPrevDrawFramebuffer ) {
+		mGl.bindFramebuffer( GL_FRAMEBUFFER, mPrevDrawFramebuffer );
+	}
+	else {
+		mGl.bindFramebuffer( GL_READ_FRAMEBUFFER, mPrevReadFramebuffer );
+		mGl.bindFramebuffer( GL_DRAW_FRAMEBUFFER, mPrevDrawFramebuffer );
+	}
+	mGl.viewport( mPrevViewport.first.x, mPrevViewport.first.y, mPrevViewport.second.x, mPrevViewport.second.y );
+	mGl.enable( GL_MULTISAMPLE, mPrevMultisample );
+}
 
-	// Right Eye
-	glBindFramebuffer( GL_FRAMEBUFFER, rightEyeDesc.m_nRenderFramebufferId );
-	glViewport( 0, 0, mRenderSize.x, mRenderSize.y );
+void HtcVive::renderView( ViewId view, const std::function<void()>& draw )
+{
+	ensureViewFramebuffer( view );
+	const FramebufferDesc& desc = mViews[view].framebuffer;
+	const FrameView& frameView = mFrameState.views[view];
+	const glm::ivec2 size{ frameView.size };
+	// the mask follows the lenses, so only the eyes get it
+	bool masked = mDensityMaskEnabled && view <= vr::Eye_Right;
+
+	mGl.bindFramebuffer( GL_FRAMEBUFFER, desc.m_nRenderFramebufferId );
+	mGl.viewport( 0, 0, size.x, size.y );
+	if( masked ) {
+		renderDensityMask( static_cast<vr::Hmd_Eye>( view ) );
+		masked = mDensityMaskEnabled;
+	}
 	{
 		gl::ScopedViewMatrix pushView;
 		gl::ScopedProjectionMatrix pushProj;
-		gl::setViewMatrix(m_mat4eyePosRight * m_mat4HMDPose *worldPose);
-		gl::setProjectionMatrix( m_mat4ProjectionRight );
-		renderScene( vr::Eye_Right );
-		//gl::setViewMatrix(m_mat4eyePosRight * m_mat4HMDPose);
-		//renderController( vr::Eye_Right );
+		gl::setViewMatrix( frameView.view );
+		gl::setProjectionMatrix( frameView.projection );
+		mGl.forgetRawProgram();
+		draw();
+		mGl.forgetRawProgram();
 	}
-	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
 
-	glDisable( GL_MULTISAMPLE );
-
-	glBindFramebuffer( GL_READ_FRAMEBUFFER, rightEyeDesc.m_nRenderFramebufferId );
-	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, rightEyeDesc.m_nResolveFramebufferId );
+	if( masked ) {
+		mGl.disable( GL_STENCIL_TEST );
+		resolveDensityMask( static_cast<vr::Hmd_Eye>( view ) );
+		return;
+	}
 
-	glBlitFramebuffer( 0, 0, mRenderSize.x, mRenderSize.y, 0, 0, mRenderSize.x, mRenderSize.y,
+	mGl.blitFramebuffer( desc.m_nRenderFramebufferId, desc.m_nResolveFramebufferId,
+		0, 0, size.x, size.y, 0, 0, size.x, size.y,
 		GL_COLOR_BUFFER_BIT,
 		GL_LINEAR );
+}
+
+void HtcVive::setRadialDensityMask( bool enabled, float radius, float strength )
+{
+	mDensityMaskEnabled = enabled;
+	mDensityMaskRadius = std::max( radius, 0.0f );
+	// at least one quad of every 2x2 block stays shaded for the reconstruction
+	mDensityMaskStrength = glm::clamp( strength, 0.0f, 0.75f );
+	updateDensityMaskCoverage();
+}
 
-	glBindFramebuffer( GL_READ_FRAMEBUFFER, 0 );
-	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+float HtcVive::getRadialDensityMaskCoverage() const
+{
+	uint64_t pixels = uint64_t( mRenderSize.x ) * mRenderSize.y;
+	return mDensityMaskEnabled && pixels ? mDensityMaskPixels[vr::Eye_Left] / float( pixels ) : 0.0f;
+}
+
+//! Pixels in [0, \a end) of a row whose 2x2 quad column has parity \a qx.
+static int64_t countQuadColumns( int64_t end, uint32_t qx )
+{
+	int64_t even = end / 4 * 2 + std::min<int64_t>( end % 4, 2 );
+	return qx ? end - even : even;
+}
+
+void HtcVive::updateDensityMaskCoverage()
+{
+	// mirrors isMasked() in kDensityMaskFunction a row at a time: the unmasked disc is a single span of the
+	// row, and the dither masks the same quad columns on either side of it
+	for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye ) {
+		mDensityMaskPixels[eye] = 0;
+		if( ! mDensityMaskEnabled )
+			continue;
+
+		const ViewState& view = mViews[eye];
+		const glm::vec2 lensCenter( -view.projection[2][0], -view.projection[2][1] );
+		const int64_t width = view.size.x;
+		for( uint32_t y = 0; y < view.size.y; ++y ) {
+			float dy = ( y + 0.5f ) / view.size.y * 2.0f - 1.0f - lensCenter.y;
+			float halfWidthSq = mDensityMaskRadius * mDensityMaskRadius - dy * dy;
+			int64_t spanBegin = 0, spanEnd = 0;
+			if( halfWidthSq > 0 ) {
+				// pixel centers strictly inside the disc
+				float halfWidth = std::sqrt( halfWidthSq );
+				float left = ( lensCenter.x - halfWidth + 1.0f ) * 0.5f * width - 0.5f;
+				float right = ( lensCenter.x + halfWidth + 1.0f ) * 0.5f * width - 0.5f;
+				spanBegin = std::min( std::max<int64_t>( int64_t( std::floor( left ) ) + 1, 0 ), width );
+				spanEnd = std::min( std::max<int64_t>( int64_t( std::ceil( right ) ), spanBegin ), width );
+			}
+
+			uint32_t qy = ( y >> 1 ) & 1;
+			for( uint32_t qx = 0; qx < 2; ++qx ) {
+				uint32_t rank = ( qx ^ qy ) * 2 + qy;
+				if( ( rank + 0.5f ) / 4.0f < mDensityMaskStrength )
+					mDensityMaskPixels[eye] += countQuadColumns( width, qx ) - countQuadColumns( spanEnd, qx ) + countQuadColumns( spanBegin, qx );
+			}
+		}
+	}
+}
+
+void HtcVive::setDensityMaskUniforms( GLuint program, vr::Hmd_Eye eye )
+{
+	const ViewState& view = mViews[eye];
+	glProgramUniform2f( program, glGetUniformLocation( program, "viewSize" ), float( view.size.x ), float( view.size.y ) );
+	// where the optical axis lands, the projections are off-center
+	glProgramUniform2f( program, glGetUniformLocation( program, "lensCenter" ), -view.projection[2][0], -view.projection[2][1] );
+	glProgramUniform1f( program, glGetUniformLocation( program, "maskRadius" ), mDensityMaskRadius );
+	glProgramUniform1f( program, glGetUniformLocation( program, "maskStrength" ), mDensityMaskStrength );
+}
+
+void HtcVive::renderDensityMask( vr::Hmd_Eye eye )
+{
+	if( ! mDensityMaskProgram ) {
+		mDensityMaskProgram = mProgramCache.createProgram( kFullScreenVertexShader, std::string( "#version 410 core\n" ) + kDensityMaskFunction + kDensityMaskFragmentShader );
+		if( ! mDensityMaskProgram ) {
+			CI_LOG_E( "Unable to create the density mask program, disabling the mask." );
+			mDensityMaskEnabled = false;
+			return;
+		}
+	}
+
+	mGl.enable( GL_STENCIL_TEST );
+	if( ! mGl.isNull() ) {
+		const GLint zero = 0;
+		glStencilMask( 0xFF );
+		glClearBufferiv( GL_STENCIL, 0, &zero );
+		glStencilFunc( GL_ALWAYS, 1, 0xFF );
+		glStencilOp( GL_KEEP, GL_KEEP, GL_REPLACE );
+		setDensityMaskUniforms( mDensityMaskProgram, eye );
+	}
+	bool depthTest = mGl.isEnabled( GL_DEPTH_TEST );
+	mGl.disable( GL_DEPTH_TEST );
+	mGl.pushColorMask( false );
+	mGl.bindVao( mEmptyVao );
+	mGl.useProgram( mDensityMaskProgram );
+	mGl.drawArrays( GL_TRIANGLES, 0, 3 );
+	mGl.popColorMask();
+	mGl.enable( GL_DEPTH_TEST, depthTest );
+
+	// the scene only shades where the mask left the stencil at 0; early stencil rejects the rest
+	if( ! mGl.isNull() ) {
+		glStencilFunc( GL_EQUAL, 0, 0xFF );
+		glStencilOp( GL_KEEP, GL_KEEP, GL_KEEP );
+		glStencilMask( 0 );
+	}
+	mGl.recordMaskedPixels( mDensityMaskPixels[eye] );
+}
+
+void HtcVive::resolveDensityMask( vr::Hmd_Eye eye )
+{
+	const FramebufferDesc& desc = mViews[eye].framebuffer;
+
+	if( ! mDensityReconstructProgram ) {
+		mDensityReconstructProgram = mProgramCache.createProgram( kFullScreenVertexShader, std::string( "#version 410 core\n" ) + kDensityMaskFunction + kDensityReconstructFragmentShader );
+		if( ! mDensityReconstructProgram ) {
+			CI_LOG_E( "Unable to create the density reconstruction program, disabling the mask." );
+			mDensityMaskEnabled = false;
+			mGl.blitFramebuffer( desc.m_nRenderFramebufferId, desc.m_nResolveFramebufferId,
+				0, 0, mViews[eye].size.x, mViews[eye].size.y, 0, 0, mViews[eye].size.x, mViews[eye].size.y,
+				GL_COLOR_BUFFER_BIT,
+				GL_LINEAR );
+			return;
+		}
+		setSamplerUnit( mDensityReconstructProgram, "renderTexture", 0 );
+		glProgramUniform1i( mDensityReconstructProgram, glGetUniformLocation( mDensityReconstructProgram, "samples" ), 4 );
+	}
+	if( ! mGl.isNull() ) {
+		glStencilMask( 0xFF );
+		setDensityMaskUniforms( mDensityReconstructProgram, eye );
+	}
+
+	// replaces the resolve blit: each pixel averages its samples, masked ones those of their neighbors
+	mGl.bindFramebuffer( GL_FRAMEBUFFER, desc.m_nResolveFramebufferId );
+	bool blend = mGl.isEnabled( GL_BLEND );
+	bool depthTest = mGl.isEnabled( GL_DEPTH_TEST );
+	mGl.disable( GL_BLEND );
+	mGl.disable( GL_DEPTH_TEST );
+	mGl.bindTexture( GL_TEXTURE_2D_MULTISAMPLE, desc.m_nRenderTextureId, 0 );
+	mGl.bindVao( mEmptyVao );
+	mGl.useProgram( mDensityReconstructProgram );
+	mGl.drawArrays( GL_TRIANGLES, 0, 3 );
+	mGl.enable( GL_BLEND, blend );
+	mGl.enable( GL_DEPTH_TEST, depthTest );
+}
+
+static const char *kFarFieldPass = "hmd.farField";
+
+void HtcVive::setFarField( bool enabled, float splitDistance, float farClip, float overlap )
+{
+	if( ! enabled )
+		mFrameContext.releasePass( kFarFieldPass );
+
+	mFarFieldEnabled = enabled;
+	mFarFieldSplit = std::max( splitDistance, m_fNearClip );
+	mFarFieldFarClip = std::max( farClip, mFarFieldSplit );
+	mFarFieldOverlap = glm::clamp( overlap, 0.0f, mFarFieldSplit - m_fNearClip );
+}
+
+HtcVive::FieldSplit HtcVive::classifyFarField( const glm::vec3& center, float radius ) const
+{
+	if( ! mFarFieldEnabled )
+		return FIELD_NEAR;
+
+	// distance along the view axis, the split is a plane like the clip planes that implement it
+	float depth = -( mFarFieldView.view * glm::vec4( center, 1 ) ).z;
+	int split = 0;
+	if( depth - radius < mFarFieldSplit )
+		split |= FIELD_NEAR;
+	if( depth + radius > mFarFieldSplit - mFarFieldOverlap )
+		split |= FIELD_FAR;
+	return static_cast<FieldSplit>( split );
+}
+
+void HtcVive::updateFarFieldView()
+{
+	const ViewState& left = mViews[vr::Eye_Left];
+	const ViewState& right = mViews[vr::Eye_Right];
+	SharedFrustum frustum = makeCenterEyeFrustum( m_mat4HMDPose * mFrameState.worldPose, left.projection, left.deviceToView, right.projection, right.deviceToView, mFarFieldSplit - mFarFieldOverlap, mFarFieldFarClip );
+
+	// same pixel density as the eyes over the union of their fields of view
+	mFarFieldView.view = frustum.view;
+	mFarFieldView.projection = frustum.projection;
+	mFarFieldView.size = glm::uvec2( glm::vec2( mRenderSize ) * glm::vec2( left.projection[0][0] / frustum.projection[0][0], left.projection[1][1] / frustum.projection[1][1] ) );
+	mFarFieldView.active = true;
+}
+
+bool HtcVive::ensureFarFieldProgram()
+{
+	if( ! mFarFieldCompositeProgram ) {
+		mFarFieldCompositeProgram = mProgramCache.createProgram( kFullScreenVertexShader, kFarFieldCompositeFragmentShader );
+		if( ! mFarFieldCompositeProgram ) {
+			CI_LOG_E( "Unable to create the far field composite program, disabling the far field." );
+			mFarFieldEnabled = false;
+			return false;
+		}
+		setSamplerUnit( mFarFieldCompositeProgram, "farField", 0 );
+	}
+	return true;
+}
+
+void HtcVive::renderFarFieldPass( const RenderFarFieldFn& renderFarField )
+{
+	mFrameContext.renderPass( kFarFieldPass, glm::ivec2( mFarFieldView.size ), gl::Fbo::Format().samples( 4 ), [&]( const FrameContext& ) {
+		gl::setViewMatrix( mFarFieldView.view );
+		gl::setProjectionMatrix( mFarFieldView.projection );
+		renderFarField( mFarFieldView );
+	} );
+}
+
+void HtcVive::compositeFarField( vr::Hmd_Eye eye )
+{
+	const FrameView& frameView = mFrameState.views[eye];
+	if( ! mGl.isNull() ) {
+		glm::mat4 eyeToFarField = mFarFieldView.projection * glm::mat4( glm::mat3( mFarFieldView.view * glm::inverse( frameView.view ) ) ) * glm::inverse( frameView.projection );
+		glProgramUniformMatrix4fv( mFarFieldCompositeProgram, glGetUniformLocation( mFarFieldCompositeProgram, "eyeToFarField" ), 1, GL_FALSE, &eyeToFarField[0][0] );
+		glProgramUniform2f( mFarFieldCompositeProgram, glGetUniformLocation( mFarFieldCompositeProgram, "viewSize" ), float( frameView.size.x ), float( frameView.size.y ) );
+	}
+	// runs under the density mask's stencil test when it is enabled
+	bool blend = mGl.isEnabled( GL_BLEND );
+	bool depthTest = mGl.isEnabled( GL_DEPTH_TEST );
+	mGl.disable( GL_BLEND );
+	mGl.disable( GL_DEPTH_TEST );
+	mGl.bindTexture( mFrameContext.getPass( kFarFieldPass )->getColorTexture(), 0 );
+	mGl.bindVao( mEmptyVao );
+	mGl.useProgram( mFarFieldCompositeProgram );
+	mGl.drawArrays( GL_TRIANGLES, 0, 3 );
+	mGl.enable( GL_BLEND, blend );
+	mGl.enable( GL_DEPTH_TEST, depthTest );
+
+	// the far field sits behind anything the near field draws
+	if( ! mGl.isNull() ) {
+		const GLfloat farDepth = 1.0f;
+		glClearBufferfv( GL_DEPTH, 0, &farDepth );
+	}
 }
 
 void HtcVive::renderDistortion( const ivec2& windowSize )
 {
-	glDisable( GL_DEPTH_TEST );
-	glViewport( 0, 0, windowSize.x, windowSize.y );
+	if( ! isReady() || ! getEyeTexture( vr::Eye_Left ) || ! getEyeTexture( vr::Eye_Right ) )
+		return;
 
-	glBindVertexArray( m_unLensVAO );
-	glUseProgram( mGlslLens->getHandle() );
+	mGl.disable( GL_DEPTH_TEST );
+	mGl.forgetRawProgram();
+
+	GLuint program = getDistortionProgram( mDistortionMode, mDistortionQuality );
+	switch( mDistortionMode ) {
+	case DISTORTION_LOOKUP:
+		renderDistortionLookup( windowSize, program );
+		break;
+	case DISTORTION_COMPUTE:
+		renderDistortionCompute( windowSize, program );
+		break;
+	default:
+		renderDistortionMesh( windowSize, program );
+		break;
+	}
+}
+
+void HtcVive::setDistortionMode( DistortionMode mode )
+{
+	if( mode == DISTORTION_COMPUTE && ! mGl.hasCompute() ) {
+		CI_LOG_W( "Compute shaders unavailable, using the lookup distortion mode instead." );
+		mode = DISTORTION_LOOKUP;
+	}
+	mDistortionMode = mode;
+}
+
+GLuint HtcVive::getDistortionProgram( DistortionMode mode, DistortionQuality quality )
+{
+	GLuint& program = mDistortionPrograms[mode][quality];
+	if( program )
+		return program;
+
+	const char *define = quality == DISTORTION_QUALITY_GREEN_ONLY ? "GREEN_ONLY" : nullptr;
+	switch( mode ) {
+	case DISTORTION_LOOKUP:
+		program = mProgramCache.createProgram( kFullScreenVertexShader, addDefine( kLookupFragmentShader, define ) );
+		setSamplerUnit( program, "eyeTexture", 0 );
+		setSamplerUnit( program, "lookupGreenMask", 1 );
+		setSamplerUnit( program, "lookupRedBlue", 2 );
+		break;
+	case DISTORTION_COMPUTE:
+		program = mProgramCache.createComputeProgram( addDefine( kLookupComputeShader, define ) );
+		break;
+	default:
+		program = mProgramCache.createProgram( kLensVertexShader, addDefine( kLensFragmentShader, define ) );
+		break;
+	}
+
+	if( ! program )
+		CI_LOG_E( "Unable to create distortion program for mode " << mode << ", quality " << quality );
+	return program;
+}
+
+void HtcVive::releaseDistortionLookup()
+{
+	glDeleteFramebuffers( 1, &mLookupFramebuffer );
+	glDeleteFramebuffers( 1, &mComputeFramebuffer );
+	mLookupFramebuffer = 0;
+	mComputeFramebuffer = 0;
+	mLookupGreenMask.reset();
+	mLookupRedBlue.reset();
+	mComputeTarget.reset();
+	mLookupSize = ivec2( 0 );
+}
+
+void HtcVive::bakeDistortionLookup( const ivec2& windowSize )
+{
+	releaseDistortionLookup();
+
+	if( ! mLookupBakeProgram ) {
+		mLookupBakeProgram = mProgramCache.createProgram( kLensVertexShader, kLookupBakeFragmentShader );
+		if( ! mLookupBakeProgram ) {
+			CI_LOG_E( "Unable to create the distortion lookup bake program." );
+			return;
+		}
+	}
+
+	gl::Texture2d::Format fmt;
+	fmt.internalFormat( GL_RGBA32F ).dataType( GL_FLOAT ).minFilter( GL_NEAREST ).magFilter( GL_NEAREST ).wrap( GL_CLAMP_TO_EDGE );
+	mLookupGreenMask = gl::Texture2d::create( windowSize.x, windowSize.y, fmt );
+	mLookupRedBlue = gl::Texture2d::create( windowSize.x, windowSize.y, fmt );
+	mGl.recordTextureUpload( 2 * windowSize.x * windowSize.y * 4 * sizeof( float ) );
+
+	// created for real like every resource, the framebuffer's draw buffers are part of it
+	glGenFramebuffers( 1, &mLookupFramebuffer );
+	{
+		gl::ScopedFramebuffer scopedFbo{ GL_FRAMEBUFFER, mLookupFramebuffer };
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mLookupGreenMask->getId(), 0 );
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, mLookupRedBlue->getId(), 0 );
+		const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers( 2, drawBuffers );
+		if( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE ) {
+			CI_LOG_E( "Incomplete distortion lookup framebuffer." );
+		}
+	}
+
+	GLuint prevFramebuffer = mGl.getFramebuffer( GL_DRAW_FRAMEBUFFER );
+	std::pair<ivec2, ivec2> prevViewport = mGl.getViewport();
+	mGl.bindFramebuffer( GL_DRAW_FRAMEBUFFER, mLookupFramebuffer );
+	mGl.viewport( 0, 0, windowSize.x, windowSize.y );
+
+	// pixels outside the lens grid keep a zero mask and stay black
+	if( ! mGl.isNull() ) {
+		const GLfloat zero[] = { 0, 0, 0, 0 };
+		glClearBufferfv( GL_COLOR, 0, zero );
+		glClearBufferfv( GL_COLOR, 1, zero );
+	}
+	mGl.bindVao( mLensVao );
+	mGl.useProgram( mLookupBakeProgram );
+	mGl.drawElements( GL_TRIANGLES, m_uiIndexSize, GL_UNSIGNED_SHORT, 0 );
+
+	mGl.bindFramebuffer( GL_DRAW_FRAMEBUFFER, prevFramebuffer );
+	mGl.viewport( prevViewport.first.x, prevViewport.first.y, prevViewport.second.x, prevViewport.second.y );
+
+#if CINDER_VIVE_GL_COMPUTE
+	if( mGl.hasCompute() ) {
+		gl::Texture2d::Format targetFmt;
+		targetFmt.internalFormat( GL_RGBA8 ).minFilter( GL_NEAREST ).magFilter( GL_NEAREST ).immutableStorage();
+		mComputeTarget = gl::Texture2d::create( windowSize.x, windowSize.y, targetFmt );
+
+		glGenFramebuffers( 1, &mComputeFramebuffer );
+		gl::ScopedFramebuffer scopedFbo{ GL_FRAMEBUFFER, mComputeFramebuffer };
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mComputeTarget->getId(), 0 );
+	}
+#endif
+
+	mLookupSize = windowSize;
+}
+
+void HtcVive::renderDistortionMesh( const ivec2& windowSize, GLuint program )
+{
+	mGl.viewport( 0, 0, windowSize.x, windowSize.y );
+
+	mGl.bindVao( mLensVao );
+	mGl.useProgram( program );
 
 	//render left lens (first half of index array )
-	leftEyeDesc.mResolveTexture->bind();
-	glDrawElements( GL_TRIANGLES, m_uiIndexSize / 2, GL_UNSIGNED_SHORT, 0 );
+	mGl.bindTexture( getEyeTexture( vr::Eye_Left ) );
+	mGl.drawElements( GL_TRIANGLES, m_uiIndexSize / 2, GL_UNSIGNED_SHORT, 0 );
 
 	//render right lens (second half of index array )
-	rightEyeDesc.mResolveTexture->bind();
-	glDrawElements( GL_TRIANGLES, m_uiIndexSize / 2, GL_UNSIGNED_SHORT, (const void *)(m_uiIndexSize) );
+	mGl.bindTexture( getEyeTexture( vr::Eye_Right ) );
+	mGl.drawElements( GL_TRIANGLES, m_uiIndexSize / 2, GL_UNSIGNED_SHORT, (const void *)(m_uiIndexSize) );
+}
+
+void HtcVive::renderDistortionLookup( const ivec2& windowSize, GLuint program )
+{
+	if( mLookupSize != windowSize )
+		bakeDistortionLookup( windowSize );
+
+	mGl.bindVao( mEmptyVao );
+	mGl.useProgram( program );
+	mGl.bindTexture( mLookupGreenMask, 1 );
+	mGl.bindTexture( mLookupRedBlue, 2 );
+
+	// one full-screen triangle per half; the lookup is addressed by window pixel, not by viewport
+	int half = windowSize.x / 2;
+	mGl.viewport( 0, 0, half, windowSize.y );
+	mGl.bindTexture( getEyeTexture( vr::Eye_Left ), 0 );
+	mGl.drawArrays( GL_TRIANGLES, 0, 3 );
+
+	mGl.viewport( half, 0, windowSize.x - half, windowSize.y );
+	mGl.bindTexture( getEyeTexture( vr::Eye_Right ), 0 );
+	mGl.drawArrays( GL_TRIANGLES, 0, 3 );
+}
+
+void HtcVive::renderDistortionCompute( const ivec2& windowSize, GLuint program )
+{
+#if CINDER_VIVE_GL_COMPUTE
+	if( mLookupSize != windowSize )
+		bakeDistortionLookup( windowSize );
+
+	mGl.useProgram( program );
+	mGl.bindTexture( getEyeTexture( vr::Eye_Left ), 0 );
+	mGl.bindTexture( getEyeTexture( vr::Eye_Right ), 1 );
+	mGl.bindTexture( mLookupGreenMask, 2 );
+	mGl.bindTexture( mLookupRedBlue, 3 );
+	if( ! mGl.isNull() )
+		glBindImageTexture( 0, mComputeTarget->getId(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8 );
+
+	mGl.dispatchCompute( ( windowSize.x + 7 ) / 8, ( windowSize.y + 7 ) / 8, 1 );
+	if( ! mGl.isNull() )
+		glMemoryBarrier( GL_FRAMEBUFFER_BARRIER_BIT );
+
+	GLuint readFramebuffer = mGl.getFramebuffer( GL_READ_FRAMEBUFFER );
+	GLuint drawFramebuffer = mGl.getFramebuffer( GL_DRAW_FRAMEBUFFER );
+	mGl.blitFramebuffer( mComputeFramebuffer, drawFramebuffer,
+		0, 0, windowSize.x, windowSize.y, 0, 0, windowSize.x, windowSize.y,
+		GL_COLOR_BUFFER_BIT,
+		GL_NEAREST );
+	mGl.bindFramebuffer( GL_READ_FRAMEBUFFER, readFramebuffer );
+#else
+	renderDistortionLookup( windowSize, getDistortionProgram( DISTORTION_LOOKUP, mDistortionQuality ) );
+#endif
+}
+
+std::vector<HtcVive::DistortionTiming> HtcVive::benchmarkDistortion( const ivec2& windowSize, int numFrames )
+{
+	std::vector<DistortionTiming> results;
+	if( ! isReady() || numFrames <= 0 )
+		return results;
+
+	DistortionMode prevMode = mDistortionMode;
+	DistortionQuality prevQuality = mDistortionQuality;
+
+	// offscreen, so the window contents are left alone
+	auto target = gl::Fbo::create( windowSize.x, windowSize.y, gl::Fbo::Format().disableDepth() );
+	gl::ScopedFramebuffer scopedFbo{ target };
+
+	GLuint query = 0;
+	glGenQueries( 1, &query );
+
+	for( int mode = 0; mode < DISTORTION_MODE_COUNT; ++mode ) {
+		if( mode == DISTORTION_COMPUTE && ! mGl.hasCompute() )
+			continue;
+
+		for( int quality = 0; quality < DISTORTION_QUALITY_COUNT; ++quality ) {
+			DistortionTiming timing;
+			timing.mode = mDistortionMode = static_cast<DistortionMode>( mode );
+			timing.quality = mDistortionQuality = static_cast<DistortionQuality>( quality );
+			timing.bakeMilliseconds = 0;
+
+			// compile outside the timed region
+			if( ! getDistortionProgram( timing.mode, timing.quality ) )
+				continue;
+
+			GLuint64 elapsed = 0;
+			if( mode != DISTORTION_MESH ) {
+				glBeginQuery( GL_TIME_ELAPSED, query );
+				bakeDistortionLookup( windowSize );
+				glEndQuery( GL_TIME_ELAPSED );
+				glGetQueryObjectui64v( query, GL_QUERY_RESULT, &elapsed );
+				timing.bakeMilliseconds = elapsed / 1.0e6;
+			}
+
+			// warm up, then drain the pipeline so earlier work isn't billed to this mode
+			renderDistortion( windowSize );
+			glFinish();
+
+			Timer timer{ true };
+			glBeginQuery( GL_TIME_ELAPSED, query );
+			for( int i = 0; i < numFrames; ++i ) {
+				renderDistortion( windowSize );
+			}
+			glEndQuery( GL_TIME_ELAPSED );
+			timer.stop();
+
+			glGetQueryObjectui64v( query, GL_QUERY_RESULT, &elapsed );
+			timing.gpuMilliseconds = elapsed / 1.0e6 / numFrames;
+			timing.cpuMilliseconds = timer.getSeconds() * 1000.0 / numFrames;
+			results.push_back( timing );
+
+			CI_LOG_I( "Distortion mode " << mode << " quality " << quality << ": " << timing.gpuMilliseconds << " ms GPU, "
+				<< timing.cpuMilliseconds << " ms CPU, " << timing.bakeMilliseconds << " ms bake" );
+		}
+	}
+
+	glDeleteQueries( 1, &query );
 
-	glBindVertexArray( 0 );
-	glUseProgram( 0 );
+	mDistortionMode = prevMode;
+	mDistortionQuality = prevQuality;
+	return results;
 }
 
 glm::mat4 HtcVive::getHMDMatrixProjectionEye( vr::Hmd_Eye nEye )
+{
+	return getProjectionEye( nEye, m_fNearClip, m_fFarClip );
+}
+
+glm::mat4 HtcVive::getProjectionEye( vr::Hmd_Eye nEye, float nearClip, float farClip ) const
 {
 	if( ! mHMD )
 		return glm::mat4();
 
-	auto mat = mHMD->GetProjectionMatrix( nEye, m_fNearClip, m_fFarClip, vr::API_OpenGL );
+	auto mat = mHMD->GetProjectionMatrix( nEye, nearClip, farClip, vr::API_OpenGL );
 
 	return glm::mat4(
 		mat.m[0][0], mat.m[1][0], mat.m[2][0], mat.m[3][0],
@@ -641,17 +2069,7 @@ glm::mat4 HtcVive::getHMDMatrixPoseEye( vr::Hmd_Eye nEye )
 
 glm::mat4 HtcVive::getCurrentViewMatrix(vr::Hmd_Eye nEye)
 {
-	glm::mat4 matMV;
-	if (nEye == vr::Eye_Left)
-	{
-		matMV = m_mat4eyePosLeft * m_mat4HMDPose;
-	}
-	else if (nEye == vr::Eye_Right)
-	{
-		matMV = m_mat4eyePosRight * m_mat4HMDPose;
-	}
-
-	return matMV;
+	return mViews[nEye].deviceToView * m_mat4HMDPose;
 }
 
 glm::mat4 HtcVive::getCurrentViewMatrix()
@@ -661,22 +2079,28 @@ glm::mat4 HtcVive::getCurrentViewMatrix()
 
 glm::mat4 HtcVive::getCurrentViewProjectionMatrix( vr::Hmd_Eye nEye )
 {
-	glm::mat4 matMVP;
-	if( nEye == vr::Eye_Left )
-	{
-		matMVP = m_mat4ProjectionLeft * m_mat4eyePosLeft * m_mat4HMDPose;
-	}
-	else if( nEye == vr::Eye_Right )
-	{
-		matMVP = m_mat4ProjectionRight * m_mat4eyePosRight *  m_mat4HMDPose;
-	}
-
-	return matMVP;
+	return mViews[nEye].projection * mViews[nEye].deviceToView * m_mat4HMDPose;
 }
 
 void HtcVive::updateHMDMatrixPose()
 {
-	vr::VRCompositor()->WaitGetPoses( mTrackedDevicePose.data(), vr::k_unMaxTrackedDeviceCount, NULL, 0 );
+	if( mFrameScheduler.isRunning() ) {
+		// on timeout the previous poses are kept rather than stalling the app
+		PoseFrame frame;
+		if( mFrameScheduler.pop( frame ) ) {
+			mTrackedDevicePose = frame.poses;
+			double returned = std::chrono::duration<double>( frame.timestamp.time_since_epoch() ).count();
+			mPoseHistory.push( returned - frame.secondsSinceVsync + mPosePrediction, mTrackedDevicePose.data(), vr::k_unMaxTrackedDeviceCount );
+		}
+	}
+	else {
+		vr::VRCompositor()->WaitGetPoses( mTrackedDevicePose.data(), vr::k_unMaxTrackedDeviceCount, NULL, 0 );
+		double returned = PoseHistory::now();
+		float secondsSinceVsync;
+		uint64_t vsyncCounter;
+		mHMD->GetTimeSinceLastVsync( &secondsSinceVsync, &vsyncCounter );
+		mPoseHistory.push( returned - secondsSinceVsync + mPosePrediction, mTrackedDevicePose.data(), vr::k_unMaxTrackedDeviceCount );
+	}
 
 	m_iValidPoseCount = 0;
 	m_strPoseClasses = "";
@@ -692,7 +2116,7 @@ void HtcVive::updateHMDMatrixPose()
 			mDevicePose[nDevice] = convertSteamVRMatrixToMat4(trackedDevicePose.mDeviceToAbsoluteTracking );
 			if( m_rDevClassChar[nDevice] == 0 )
 			{
-				switch( mHMD->GetTrackedDeviceClass( nDevice ) )
+				switch( mDeviceProperties.getDeviceClass( nDevice ) )
 				{
 				case vr::TrackedDeviceClass_Controller:        m_rDevClassChar[nDevice] = 'C'; break;
 				case vr::TrackedDeviceClass_HMD:               m_rDevClassChar[nDevice] = 'H'; break;
@@ -705,7 +2129,7 @@ void HtcVive::updateHMDMatrixPose()
 			m_strPoseClasses += m_rDevClassChar[nDevice];
 		}
 
-		vr::ETrackedControllerRole role = mHMD->GetControllerRoleForTrackedDeviceIndex(nDevice);
+		vr::ETrackedControllerRole role = mDeviceProperties.getControllerRole(nDevice);
 		if (role == vr::TrackedControllerRole_LeftHand) {
 			mDeviceIndexLeft = nDevice;
 			hmd::HandControllerState& state = mHandControllerState[vr::Eye_Left];
@@ -724,9 +2148,10 @@ void HtcVive::updateHMDMatrixPose()
 			state.gripButton = (cs.ulButtonPressed & vr::ButtonMaskFromId(vr::k_EButton_Grip)) != 0;
 			state.trackpadButton = (cs.ulButtonTouched & vr::ButtonMaskFromId(vr::k_EButton_SteamVR_Touchpad)) != 0;
 			state.triggerButton = (cs.ulButtonTouched & vr::ButtonMaskFromId(vr::k_EButton_SteamVR_Trigger)) != 0;
-			state.trackpad.x = cs.rAxis[0].x;
-			state.trackpad.y = cs.rAxis[0].x;
-			state.trigger = cs.rAxis[1].x;
+			uint32_t trackpadAxis = mDeviceProperties.findAxis( nDevice, vr::k_eControllerAxis_TrackPad, 0 );
+			state.trackpad.x = cs.rAxis[trackpadAxis].x;
+			state.trackpad.y = cs.rAxis[trackpadAxis].y;
+			state.trigger = cs.rAxis[mDeviceProperties.findAxis( nDevice, vr::k_eControllerAxis_Trigger, 1 )].x;
 
 		} 
 		else if (role == vr::TrackedControllerRole_RightHand) {
@@ -747,9 +2172,10 @@ void HtcVive::updateHMDMatrixPose()
 			state.gripButton = (cs.ulButtonPressed & vr::ButtonMaskFromId(vr::k_EButton_Grip)) != 0;
 			state.trackpadButton = (cs.ulButtonTouched & vr::ButtonMaskFromId(vr::k_EButton_SteamVR_Touchpad)) != 0;
 			state.triggerButton = (cs.ulButtonTouched & vr::ButtonMaskFromId(vr::k_EButton_SteamVR_Trigger)) != 0;
-			state.trackpad.x = cs.rAxis[0].x;
-			state.trackpad.y = cs.rAxis[0].x;
-			state.trigger = cs.rAxis[1].x;
+			uint32_t trackpadAxis = mDeviceProperties.findAxis( nDevice, vr::k_eControllerAxis_TrackPad, 0 );
+			state.trackpad.x = cs.rAxis[trackpadAxis].x;
+			state.trackpad.y = cs.rAxis[trackpadAxis].y;
+			state.trigger = cs.rAxis[mDeviceProperties.findAxis( nDevice, vr::k_eControllerAxis_Trigger, 1 )].x;
 		}
 	}
 
@@ -757,38 +2183,47 @@ void HtcVive::updateHMDMatrixPose()
 	{
 		m_mat4HMDPose = glm::inverse( mDevicePose[vr::k_unTrackedDeviceIndex_Hmd] );
 	}
+	mChaperone.computeProximity( mTrackedDevicePose, &mBoundsProximity );
 }
 
-RenderModelRef HtcVive::findOrLoadRenderModel( const std::string& name )
+RenderModelRef HtcVive::loadRenderModel( const std::string& name )
 {
-	auto resIt = std::find_if( std::begin( mRenderModels ), std::end( mRenderModels ), [&]( const RenderModelRef& m ) {
-		return m->GetName() == name;
-	} );
-
-	// load the model if we didn't find one
-	if( resIt == std::end( mRenderModels ) ) {
-		vr::RenderModel_t *pModel = NULL;
-		if( !vr::VRRenderModels()->LoadRenderModel_Async( name.c_str(), &pModel ) || pModel == NULL ) {
-			CI_LOG_E( "Unable to load render model " << name );
-			return nullptr; // move on to the next tracked device
+	QuantizedMesh mesh;
+	vr::RenderModel_TextureMap_t *pTexture = NULL;
+	auto decodedIt = mDecodedRenderModels.find( name );
+	if( decodedIt != mDecodedRenderModels.end() && decodedIt->second.textureUpload.valid() ) {
+		// usually resolved already, the uploads were queued when the model was decoded
+		DecodedRenderModel decoded = std::move( decodedIt->second );
+		mDecodedRenderModels.erase( decodedIt );
+		try {
+			return RenderModel::create( name, decoded.mesh, decoded.vertexUpload.get(), decoded.indexUpload.get(), decoded.textureUpload.get(), mModelProgram );
 		}
-
-		vr::RenderModel_TextureMap_t *pTexture = NULL;
-		if( !vr::VRRenderModels()->LoadTexture_Async( pModel->diffuseTextureId, &pTexture ) || pTexture == NULL ) {
-			CI_LOG_E( "Unable to load render texture id:%d for render model %s\n", pModel->diffuseTextureId, pchRenderModelName );
-			vr::VRRenderModels()->FreeRenderModel( pModel );
-			return nullptr; // move on to the next tracked device
+		catch( const std::exception& exc ) {
+			CI_LOG_E( "Background upload of render model " << name << " failed: " << exc.what() );
+			return nullptr;
 		}
+	}
+	else if( decodedIt != mDecodedRenderModels.end() ) {
+		mesh = std::move( decodedIt->second.mesh );
+		pTexture = decodedIt->second.texture;
+		mDecodedRenderModels.erase( decodedIt );
+	}
+	else {
+		// first loads and reloads of evicted models alike are decoded by requestRenderModelDecode() beforehand
+		CI_LOG_E( "Render model " << name << " was not decoded before it was acquired." );
+		return nullptr;
+	}
 
-		auto model = RenderModel::create( name, *pModel, *pTexture, mGlslModel );
-		mRenderModels.emplace_back( model );
+	CI_LOG_V( "Render model " << name << ": ACMR " << mesh.acmrBefore << " -> " << mesh.acmrAfter );
 
-		vr::VRRenderModels()->FreeRenderModel( pModel );
-		vr::VRRenderModels()->FreeTexture( pTexture );
+	auto model = RenderModel::create( name, mesh, *pTexture, mModelProgram );
+	mGl.recordBufferUpload( mesh.vertices.size() * sizeof( QuantizedVertex ) );
+	mGl.recordBufferUpload( mesh.indices.size() * sizeof( uint16_t ) );
+	mGl.recordTextureUpload( pTexture->unWidth * pTexture->unHeight * 4 );
 
-		return model;
-	}
-	return nullptr;
+	vr::VRRenderModels()->FreeTexture( pTexture );
+
+	return model;
 }
 
 
@@ -0,0 +1,286 @@
+#include "ViveChaperone.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <emmintrin.h>
+
+using namespace ci;
+using namespace std;
+using namespace hmd;
+
+static_assert( vr::k_unMaxTrackedDeviceCount % 4 == 0, "The proximity kernel handles four device slots per lane." );
+
+BoundsProximity::BoundsProximity()
+	: nearestDevice( vr::k_unTrackedDeviceIndexInvalid )
+	, nearestDistance( FLT_MAX )
+{
+	distance.fill( FLT_MAX );
+	wall.fill( 0 );
+	valid.fill( false );
+}
+
+ChaperoneCache::ChaperoneCache()
+	: mChaperone( nullptr )
+	, mChaperoneSetup( nullptr )
+	, mOverridden( false )
+	, mRevision( 0 )
+	, mPlayAreaSize( 0 )
+	, mBoundsMeshRevision( 0 )
+{
+	mPlayAreaRect.fill( glm::vec3( 0 ) );
+}
+
+void ChaperoneCache::refresh()
+{
+	if( mOverridden || ! mChaperone )
+		return;
+
+	std::vector<vr::HmdQuad_t> quads;
+	vr::HmdQuad_t playAreaRect = {};
+	if( mChaperone->GetCalibrationState() == vr::ChaperoneCalibrationState_OK ) {
+		mChaperone->GetPlayAreaRect( &playAreaRect );
+
+		// the first call only reports the number of walls
+		uint32_t count = 0;
+		if( mChaperoneSetup )
+			mChaperoneSetup->GetLiveCollisionBoundsInfo( nullptr, &count );
+		if( count > 0 ) {
+			quads.resize( count );
+			if( ! mChaperoneSetup->GetLiveCollisionBoundsInfo( quads.data(), &count ) )
+				quads.clear();
+		}
+	}
+
+	setWalls( quads, playAreaRect );
+}
+
+void ChaperoneCache::handleEvent( const vr::VREvent_t& event )
+{
+	switch( event.eventType ) {
+	case vr::VREvent_ChaperoneDataHasChanged:
+	case vr::VREvent_ChaperoneUniverseHasChanged:
+	case vr::VREvent_ChaperoneTempDataHasChanged:
+	case vr::VREvent_ChaperoneSettingsHaveChanged:
+		refresh();
+		break;
+	default:
+		break;
+	}
+}
+
+void ChaperoneCache::setBounds( const std::vector<vr::HmdQuad_t>& quads, const vr::HmdQuad_t& playAreaRect )
+{
+	mOverridden = true;
+	setWalls( quads, playAreaRect );
+}
+
+void ChaperoneCache::setRectangularBounds( float sizeX, float sizeZ, float height )
+{
+	const float x = sizeX * 0.5f, z = sizeZ * 0.5f;
+	const glm::vec2 corners[4] = { glm::vec2( -x, -z ), glm::vec2( x, -z ), glm::vec2( x, z ), glm::vec2( -x, z ) };
+
+	std::vector<vr::HmdQuad_t> quads( 4 );
+	vr::HmdQuad_t playAreaRect;
+	for( int i = 0; i < 4; ++i ) {
+		const glm::vec2& a = corners[i];
+		const glm::vec2& b = corners[( i + 1 ) % 4];
+		vr::HmdVector3_t wall[4] = { { a.x, 0, a.y }, { b.x, 0, b.y }, { b.x, height, b.y }, { a.x, height, a.y } };
+		std::copy( wall, wall + 4, quads[i].vCorners );
+		playAreaRect.vCorners[i] = wall[0];
+	}
+
+	setBounds( quads, playAreaRect );
+}
+
+void ChaperoneCache::clearBoundsOverride()
+{
+	mOverridden = false;
+	refresh();
+}
+
+void ChaperoneCache::setWalls( const std::vector<vr::HmdQuad_t>& quads, const vr::HmdQuad_t& playAreaRect )
+{
+	mQuads = quads;
+	for( int i = 0; i < 4; ++i ) {
+		const vr::HmdVector3_t& corner = playAreaRect.vCorners[i];
+		mPlayAreaRect[i] = glm::vec3( corner.v[0], corner.v[1], corner.v[2] );
+	}
+	mPlayAreaSize = glm::vec2( glm::distance( mPlayAreaRect[0], mPlayAreaRect[1] ), glm::distance( mPlayAreaRect[1], mPlayAreaRect[2] ) );
+
+	mWallA.clear();
+	mWallDelta.clear();
+	mWallInvLengthSq.clear();
+	mWallSlope.clear();
+	mWallHeight.clear();
+
+	auto addWall = [this]( const glm::vec2& a, const glm::vec2& b, const glm::vec2& height ) {
+		glm::vec2 delta = b - a;
+		float lengthSq = glm::dot( delta, delta );
+		mWallA.push_back( a );
+		mWallDelta.push_back( delta );
+		mWallInvLengthSq.push_back( lengthSq > 0 ? 1.0f / lengthSq : 0.0f );
+		mWallSlope.push_back( delta.y != 0 ? delta.x / delta.y : 0.0f );
+		mWallHeight.push_back( height );
+	};
+
+	for( const auto& quad : mQuads ) {
+		// walls are vertical, so their footprint is the pair of corners furthest apart on the floor
+		glm::vec2 a( quad.vCorners[0].v[0], quad.vCorners[0].v[2] );
+		glm::vec2 b = a;
+		glm::vec2 height( quad.vCorners[0].v[1] );
+		for( const auto& corner : quad.vCorners ) {
+			glm::vec2 point( corner.v[0], corner.v[2] );
+			if( glm::distance( a, point ) > glm::distance( a, b ) )
+				b = point;
+			height = glm::vec2( std::min( height.x, corner.v[1] ), std::max( height.y, corner.v[1] ) );
+		}
+		addWall( a, b, height );
+	}
+
+	// without collision bounds the play area edges are the walls
+	if( mWallA.empty() && mPlayAreaSize.x > 0 && mPlayAreaSize.y > 0 ) {
+		for( int i = 0; i < 4; ++i ) {
+			const glm::vec3& a = mPlayAreaRect[i];
+			const glm::vec3& b = mPlayAreaRect[( i + 1 ) % 4];
+			addWall( glm::vec2( a.x, a.z ), glm::vec2( b.x, b.z ), glm::vec2( 0.0f, 2.5f ) );
+		}
+	}
+
+	++mRevision;
+}
+
+void ChaperoneCache::computeProximity( const std::array<vr::TrackedDevicePose_t, vr::k_unMaxTrackedDeviceCount>& poses, BoundsProximity *result ) const
+{
+	*result = BoundsProximity();
+	if( mWallA.empty() )
+		return;
+
+	// device positions on the floor plane, structure of arrays so each lane holds one device
+	float px[vr::k_unMaxTrackedDeviceCount], pz[vr::k_unMaxTrackedDeviceCount];
+	for( uint32_t device = 0; device < vr::k_unMaxTrackedDeviceCount; ++device ) {
+		const vr::HmdMatrix34_t& pose = poses[device].mDeviceToAbsoluteTracking;
+		px[device] = pose.m[0][3];
+		pz[device] = pose.m[2][3];
+		result->valid[device] = poses[device].bPoseIsValid;
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 signMask = _mm_set1_ps( -0.0f );
+	float distance[4];
+	int32_t wall[4];
+
+	for( uint32_t base = 0; base < vr::k_unMaxTrackedDeviceCount; base += 4 ) {
+		const __m128 x = _mm_loadu_ps( px + base );
+		const __m128 z = _mm_loadu_ps( pz + base );
+		__m128 bestSq = _mm_set1_ps( FLT_MAX );
+		__m128i bestWall = _mm_setzero_si128();
+		__m128 inside = _mm_setzero_ps();
+
+		for( size_t i = 0; i < mWallA.size(); ++i ) {
+			const __m128 ax = _mm_set1_ps( mWallA[i].x );
+			const __m128 az = _mm_set1_ps( mWallA[i].y );
+			const __m128 dx = _mm_set1_ps( mWallDelta[i].x );
+			const __m128 dz = _mm_set1_ps( mWallDelta[i].y );
+
+			// closest point on the segment
+			const __m128 rx = _mm_sub_ps( x, ax );
+			const __m128 rz = _mm_sub_ps( z, az );
+			__m128 t = _mm_mul_ps( _mm_add_ps( _mm_mul_ps( rx, dx ), _mm_mul_ps( rz, dz ) ), _mm_set1_ps( mWallInvLengthSq[i] ) );
+			t = _mm_min_ps( _mm_max_ps( t, zero ), one );
+			const __m128 ex = _mm_sub_ps( rx, _mm_mul_ps( t, dx ) );
+			const __m128 ez = _mm_sub_ps( rz, _mm_mul_ps( t, dz ) );
+			const __m128 distSq = _mm_add_ps( _mm_mul_ps( ex, ex ), _mm_mul_ps( ez, ez ) );
+
+			const __m128i closer = _mm_castps_si128( _mm_cmplt_ps( distSq, bestSq ) );
+			bestWall = _mm_or_si128( _mm_and_si128( closer, _mm_set1_epi32( static_cast<int>( i ) ) ), _mm_andnot_si128( closer, bestWall ) );
+			bestSq = _mm_min_ps( distSq, bestSq );
+
+			// even-odd crossing test along +x; walls parallel to x never straddle
+			const __m128 straddles = _mm_xor_ps( _mm_cmpgt_ps( az, z ), _mm_cmpgt_ps( _mm_add_ps( az, dz ), z ) );
+			const __m128 crossX = _mm_add_ps( ax, _mm_mul_ps( rz, _mm_set1_ps( mWallSlope[i] ) ) );
+			inside = _mm_xor_ps( inside, _mm_and_ps( straddles, _mm_cmplt_ps( x, crossX ) ) );
+		}
+
+		// negative outside: the sign bit is set in the lanes that crossed an even number of walls
+		__m128 signedDistance = _mm_sqrt_ps( bestSq );
+		signedDistance = _mm_or_ps( signedDistance, _mm_andnot_ps( inside, signMask ) );
+		_mm_storeu_ps( distance, signedDistance );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( wall ), bestWall );
+
+		for( uint32_t lane = 0; lane < 4; ++lane ) {
+			uint32_t device = base + lane;
+			if( ! result->valid[device] )
+				continue;
+
+			result->distance[device] = distance[lane];
+			result->wall[device] = static_cast<uint32_t>( wall[lane] );
+			if( distance[lane] < result->nearestDistance ) {
+				result->nearestDistance = distance[lane];
+				result->nearestDevice = device;
+			}
+		}
+	}
+}
+
+gl::VboMeshRef ChaperoneCache::getBoundsMesh()
+{
+	if( mWallA.empty() )
+		return nullptr;
+	if( mBoundsMesh && mBoundsMeshRevision == mRevision )
+		return mBoundsMesh;
+
+	struct Vertex {
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec2 texCoord;
+	};
+	std::vector<Vertex> vertices;
+	std::vector<uint16_t> indices;
+	vertices.reserve( mWallA.size() * 4 );
+	indices.reserve( mWallA.size() * 6 );
+
+	// inward is to the left of the wall direction for counter-clockwise bounds, flipped per wall if its
+	// midpoint nudged along that side falls outside
+	float perimeter = 0;
+	for( size_t i = 0; i < mWallA.size(); ++i ) {
+		const glm::vec2 a = mWallA[i];
+		const glm::vec2 b = a + mWallDelta[i];
+		const float length = glm::length( mWallDelta[i] );
+		glm::vec2 normal = length > 0 ? glm::vec2( -mWallDelta[i].y, mWallDelta[i].x ) / length : glm::vec2( 0 );
+
+		glm::vec2 probe = ( a + b ) * 0.5f + normal * 0.01f;
+		bool probeInside = false;
+		for( size_t j = 0; j < mWallA.size(); ++j ) {
+			float az = mWallA[j].y, bz = mWallA[j].y + mWallDelta[j].y;
+			if( ( az > probe.y ) != ( bz > probe.y ) && probe.x < mWallA[j].x + ( probe.y - az ) * mWallSlope[j] )
+				probeInside = ! probeInside;
+		}
+		if( ! probeInside )
+			normal = -normal;
+
+		const glm::vec2& height = mWallHeight[i];
+		const glm::vec3 n( normal.x, 0, normal.y );
+		uint16_t first = static_cast<uint16_t>( vertices.size() );
+		vertices.push_back( Vertex{ glm::vec3( a.x, height.x, a.y ), n, glm::vec2( perimeter, height.x ) } );
+		vertices.push_back( Vertex{ glm::vec3( b.x, height.x, b.y ), n, glm::vec2( perimeter + length, height.x ) } );
+		vertices.push_back( Vertex{ glm::vec3( b.x, height.y, b.y ), n, glm::vec2( perimeter + length, height.y ) } );
+		vertices.push_back( Vertex{ glm::vec3( a.x, height.y, a.y ), n, glm::vec2( perimeter, height.y ) } );
+		const uint16_t quad[6] = { 0, 1, 2, 0, 2, 3 };
+		for( uint16_t index : quad )
+			indices.push_back( first + index );
+		perimeter += length;
+	}
+
+	auto vbo = gl::Vbo::create( GL_ARRAY_BUFFER, vertices.size() * sizeof( Vertex ), vertices.data(), GL_STATIC_DRAW );
+	auto ibo = gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof( uint16_t ), indices.data(), GL_STATIC_DRAW );
+	geom::BufferLayout layout;
+	layout.append( geom::Attrib::POSITION, 3, sizeof( Vertex ), offsetof( Vertex, position ) );
+	layout.append( geom::Attrib::NORMAL, 3, sizeof( Vertex ), offsetof( Vertex, normal ) );
+	layout.append( geom::Attrib::TEX_COORD_0, 2, sizeof( Vertex ), offsetof( Vertex, texCoord ) );
+
+	mBoundsMesh = gl::VboMesh::create( static_cast<uint32_t>( vertices.size() ), GL_TRIANGLES, { { layout, vbo } }, static_cast<uint32_t>( indices.size() ), GL_UNSIGNED_SHORT, ibo );
+	mBoundsMeshRevision = mRevision;
+	return mBoundsMesh;
+}
@@ -0,0 +1,150 @@
+#include "ViveDeviceProperties.h"
+
+using namespace std;
+using namespace hmd;
+
+DevicePropertyCache::DevicePropertyCache()
+	: mSystem( nullptr )
+	, mScratch( 256 )
+	, mNumQueries( 0 )
+{
+	mEmptyString = intern( "" );
+	for( auto& props : mDevices ) {
+		clear( props );
+	}
+}
+
+void DevicePropertyCache::clear( TrackedDeviceProperties& props )
+{
+	props.isConnected = false;
+	props.deviceClass = vr::TrackedDeviceClass_Invalid;
+	props.role = vr::TrackedControllerRole_Invalid;
+	props.trackingSystemName = mEmptyString;
+	props.serialNumber = mEmptyString;
+	props.modelNumber = mEmptyString;
+	props.manufacturerName = mEmptyString;
+	props.renderModelName = mEmptyString;
+	props.isWireless = false;
+	props.providesBatteryStatus = false;
+	props.isCharging = false;
+	props.batteryPercentage = 0.0f;
+	props.axisTypes.fill( vr::k_eControllerAxis_None );
+}
+
+void DevicePropertyCache::refresh( vr::TrackedDeviceIndex_t device )
+{
+	if( ! mSystem || device >= vr::k_unMaxTrackedDeviceCount )
+		return;
+
+	TrackedDeviceProperties& props = mDevices[device];
+	props.isConnected = mSystem->IsTrackedDeviceConnected( device );
+	++mNumQueries;
+	if( ! props.isConnected ) {
+		clear( props );
+		return;
+	}
+
+	props.deviceClass = mSystem->GetTrackedDeviceClass( device );
+	props.role = mSystem->GetControllerRoleForTrackedDeviceIndex( device );
+	props.trackingSystemName = queryString( device, vr::Prop_TrackingSystemName_String );
+	props.serialNumber = queryString( device, vr::Prop_SerialNumber_String );
+	props.modelNumber = queryString( device, vr::Prop_ModelNumber_String );
+	props.manufacturerName = queryString( device, vr::Prop_ManufacturerName_String );
+	props.renderModelName = queryString( device, vr::Prop_RenderModelName_String );
+	props.isWireless = mSystem->GetBoolTrackedDeviceProperty( device, vr::Prop_DeviceIsWireless_Bool );
+	props.providesBatteryStatus = mSystem->GetBoolTrackedDeviceProperty( device, vr::Prop_DeviceProvidesBatteryStatus_Bool );
+	props.isCharging = mSystem->GetBoolTrackedDeviceProperty( device, vr::Prop_DeviceIsCharging_Bool );
+	props.batteryPercentage = mSystem->GetFloatTrackedDeviceProperty( device, vr::Prop_DeviceBatteryPercentage_Float );
+	// class, role, the bools and the float; queryString() counts its own
+	mNumQueries += 6;
+
+	// read every frame with the controller state, to find the trackpad and trigger
+	props.axisTypes.fill( vr::k_eControllerAxis_None );
+	if( props.deviceClass == vr::TrackedDeviceClass_Controller ) {
+		for( uint32_t axis = 0; axis < vr::k_unControllerStateAxisCount; ++axis ) {
+			auto prop = static_cast<vr::ETrackedDeviceProperty>( vr::Prop_Axis0Type_Int32 + axis );
+			props.axisTypes[axis] = static_cast<vr::EVRControllerAxisType>( mSystem->GetInt32TrackedDeviceProperty( device, prop ) );
+			++mNumQueries;
+		}
+	}
+}
+
+uint32_t DevicePropertyCache::findAxis( vr::TrackedDeviceIndex_t device, vr::EVRControllerAxisType type, uint32_t fallback ) const
+{
+	const auto& axisTypes = get( device ).axisTypes;
+	for( uint32_t axis = 0; axis < axisTypes.size(); ++axis ) {
+		if( axisTypes[axis] == type )
+			return axis;
+	}
+	return fallback;
+}
+
+void DevicePropertyCache::refreshAll()
+{
+	for( vr::TrackedDeviceIndex_t device = 0; device < vr::k_unMaxTrackedDeviceCount; ++device ) {
+		refresh( device );
+	}
+}
+
+void DevicePropertyCache::refreshRoles()
+{
+	if( ! mSystem )
+		return;
+
+	// a hand swap changes both controllers, and the event doesn't reliably name each of them
+	for( vr::TrackedDeviceIndex_t device = 0; device < vr::k_unMaxTrackedDeviceCount; ++device ) {
+		TrackedDeviceProperties& props = mDevices[device];
+		if( props.isConnected && props.deviceClass == vr::TrackedDeviceClass_Controller ) {
+			props.role = mSystem->GetControllerRoleForTrackedDeviceIndex( device );
+			++mNumQueries;
+		}
+	}
+}
+
+void DevicePropertyCache::invalidate( vr::TrackedDeviceIndex_t device )
+{
+	if( device < vr::k_unMaxTrackedDeviceCount )
+		clear( mDevices[device] );
+}
+
+void DevicePropertyCache::handleEvent( const vr::VREvent_t& event )
+{
+	switch( event.eventType ) {
+	case vr::VREvent_TrackedDeviceActivated:
+	case vr::VREvent_TrackedDeviceUpdated:
+	case vr::VREvent_PropertyChanged:
+		refresh( event.trackedDeviceIndex );
+		break;
+	case vr::VREvent_TrackedDeviceRoleChanged:
+		refresh( event.trackedDeviceIndex );
+		refreshRoles();
+		break;
+	case vr::VREvent_TrackedDeviceDeactivated:
+		invalidate( event.trackedDeviceIndex );
+		break;
+	default:
+		break;
+	}
+}
+
+const std::string * DevicePropertyCache::queryString( vr::TrackedDeviceIndex_t device, vr::ETrackedDeviceProperty prop )
+{
+	uint32_t len = mSystem->GetStringTrackedDeviceProperty( device, prop, mScratch.data(), static_cast<uint32_t>( mScratch.size() ) );
+	++mNumQueries;
+
+	// the scratch buffer only grows, so long values cost a second query once
+	if( len > mScratch.size() ) {
+		mScratch.resize( len );
+		len = mSystem->GetStringTrackedDeviceProperty( device, prop, mScratch.data(), static_cast<uint32_t>( mScratch.size() ) );
+		++mNumQueries;
+	}
+	if( len == 0 )
+		return mEmptyString;
+
+	return intern( mScratch.data() );
+}
+
+const std::string * DevicePropertyCache::intern( const char *str )
+{
+	return &*mStrings.insert( std::string( str ) ).first;
+}
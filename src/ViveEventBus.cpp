@@ -0,0 +1,122 @@
+#include "ViveEventBus.h"
+
+#include <algorithm>
+
+#include "cinder/Log.h"
+
+using namespace std;
+using namespace hmd;
+
+const uint32_t EventBus::kMaxEventType;
+const uint32_t EventBus::kAnyEvent;
+
+static const uint32_t kFreeSlot = 0xFFFFFFFF;
+
+EventBus::EventBus()
+	: mFirstHandler( kAnyEvent + 1, -1 )
+	, mCounts( kAnyEvent + 1, 0 )
+	, mTotalCount( 0 )
+	, mLogSampleEvery( 0 )
+	, mLogMinInterval( 1.0 )
+	, mHasLogged( false )
+	, mSystem( nullptr )
+{
+}
+
+EventBus::SubscriptionId EventBus::subscribe( uint32_t eventType, const HandlerFn& handler )
+{
+	uint32_t handlerSlot = eventType == kAnyEvent ? kAnyEvent : slot( eventType );
+
+	// reuse a released entry before growing
+	int32_t index = -1;
+	for( size_t i = 0; i < mHandlers.size(); ++i ) {
+		if( mHandlers[i].slot == kFreeSlot ) {
+			index = static_cast<int32_t>( i );
+			break;
+		}
+	}
+	if( index < 0 ) {
+		index = static_cast<int32_t>( mHandlers.size() );
+		mHandlers.push_back( Handler() );
+	}
+
+	Handler& entry = mHandlers[index];
+	entry.fn = handler;
+	entry.next = -1;
+	entry.slot = handlerSlot;
+
+	// append so handlers run in registration order
+	int32_t *link = &mFirstHandler[handlerSlot];
+	while( *link >= 0 )
+		link = &mHandlers[*link].next;
+	*link = index;
+
+	return static_cast<SubscriptionId>( index + 1 );
+}
+
+void EventBus::unsubscribe( SubscriptionId id )
+{
+	int32_t index = static_cast<int32_t>( id ) - 1;
+	if( index < 0 || index >= static_cast<int32_t>( mHandlers.size() ) || mHandlers[index].slot == kFreeSlot )
+		return;
+
+	Handler& entry = mHandlers[index];
+	int32_t *link = &mFirstHandler[entry.slot];
+	while( *link != index )
+		link = &mHandlers[*link].next;
+	*link = entry.next;
+
+	entry.fn = nullptr;
+	entry.next = -1;
+	entry.slot = kFreeSlot;
+}
+
+bool EventBus::dispatch( const vr::VREvent_t& event )
+{
+	uint32_t eventSlot = slot( event.eventType );
+	uint32_t count = ++mCounts[eventSlot];
+	++mTotalCount;
+
+	bool handled = false;
+	for( int32_t i = mFirstHandler[eventSlot]; i >= 0; i = mHandlers[i].next ) {
+		mHandlers[i].fn( event );
+		handled = true;
+	}
+	for( int32_t i = mFirstHandler[kAnyEvent]; i >= 0; i = mHandlers[i].next ) {
+		mHandlers[i].fn( event );
+		handled = true;
+	}
+
+	if( ! handled && mLogSampleEvery > 0 )
+		logUnhandled( event, count );
+
+	return handled;
+}
+
+void EventBus::setLogSampling( uint32_t sampleEvery, double minIntervalSeconds )
+{
+	mLogSampleEvery = sampleEvery;
+	mLogMinInterval = minIntervalSeconds;
+}
+
+void EventBus::resetCounters()
+{
+	std::fill( mCounts.begin(), mCounts.end(), 0 );
+	mTotalCount = 0;
+}
+
+void EventBus::logUnhandled( const vr::VREvent_t& event, uint32_t count )
+{
+	if( ( count - 1 ) % mLogSampleEvery != 0 )
+		return;
+
+	auto now = std::chrono::steady_clock::now();
+	if( mHasLogged && std::chrono::duration<double>( now - mLastLogTime ).count() < mLogMinInterval )
+		return;
+
+	mHasLogged = true;
+	mLastLogTime = now;
+
+	const char *name = mSystem ? mSystem->GetEventTypeNameFromEnum( static_cast<vr::EVREventType>( event.eventType ) ) : nullptr;
+	CI_LOG_I( "VR Event " << ( name ? name : "" ) << " (" << event.eventType << ") seen " << count << " times." );
+}
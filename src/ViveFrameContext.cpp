@@ -0,0 +1,137 @@
+#include "ViveFrameContext.h"
+#include "CinderVive.h"
+
+using namespace ci;
+using namespace std;
+using namespace hmd;
+
+bool SharedFrustum::intersectsSphere( const glm::vec3& center, float radius ) const
+{
+	for( const auto& plane : planes ) {
+		if( glm::dot( glm::vec3( plane ), center ) + plane.w < -radius )
+			return false;
+	}
+	return true;
+}
+
+// left, right, bottom and top edges as tangents, recovered from the off-center projections
+static glm::vec4 getEnclosingTangents( const glm::mat4& leftProjection, const glm::mat4& rightProjection )
+{
+	return glm::vec4(
+		( leftProjection[2][0] - 1 ) / leftProjection[0][0],
+		( rightProjection[2][0] + 1 ) / rightProjection[0][0],
+		glm::min( ( leftProjection[2][1] - 1 ) / leftProjection[1][1], ( rightProjection[2][1] - 1 ) / rightProjection[1][1] ),
+		glm::max( ( leftProjection[2][1] + 1 ) / leftProjection[1][1], ( rightProjection[2][1] + 1 ) / rightProjection[1][1] ) );
+}
+
+static SharedFrustum makeFrustum( const glm::mat4& headView, const glm::vec3& apex, float pullback, const glm::vec4& tangents, float nearClip, float farClip )
+{
+	SharedFrustum frustum;
+	frustum.pullback = pullback;
+	frustum.view = glm::translate( glm::mat4(), -( apex + glm::vec3( 0, 0, pullback ) ) ) * headView;
+
+	float nearPlane = nearClip + pullback;
+	float farPlane = farClip + pullback;
+	frustum.projection = glm::frustum( tangents.x * nearPlane, tangents.y * nearPlane, tangents.z * nearPlane, tangents.w * nearPlane, nearPlane, farPlane );
+
+	// Gribb-Hartmann plane extraction, rows of the view-projection matrix
+	glm::mat4 m = glm::transpose( frustum.projection * frustum.view );
+	frustum.planes[0] = m[3] + m[0];
+	frustum.planes[1] = m[3] - m[0];
+	frustum.planes[2] = m[3] + m[1];
+	frustum.planes[3] = m[3] - m[1];
+	frustum.planes[4] = m[3] + m[2];
+	frustum.planes[5] = m[3] - m[2];
+	for( auto& plane : frustum.planes )
+		plane /= glm::length( glm::vec3( plane ) );
+
+	return frustum;
+}
+
+SharedFrustum hmd::makeSharedFrustum( const glm::mat4& headView, const glm::mat4& leftProjection, const glm::mat4& leftHeadToEye, const glm::mat4& rightProjection, const glm::mat4& rightHeadToEye, float nearClip, float farClip )
+{
+	glm::vec4 tangents = getEnclosingTangents( leftProjection, rightProjection );
+
+	// eye positions in head space; the apex is centered between them and pulled back until the
+	// outer plane of each eye passes through its eye
+	glm::vec3 leftEye{ glm::inverse( leftHeadToEye )[3] };
+	glm::vec3 rightEye{ glm::inverse( rightHeadToEye )[3] };
+	glm::vec3 center = ( leftEye + rightEye ) * 0.5f;
+	float pullback = 0;
+	if( tangents.x < 0 )
+		pullback = glm::max( pullback, ( leftEye.x - center.x ) / tangents.x );
+	if( tangents.y > 0 )
+		pullback = glm::max( pullback, ( rightEye.x - center.x ) / tangents.y );
+
+	return makeFrustum( headView, center, pullback, tangents, nearClip, farClip );
+}
+
+SharedFrustum hmd::makeCenterEyeFrustum( const glm::mat4& headView, const glm::mat4& leftProjection, const glm::mat4& leftHeadToEye, const glm::mat4& rightProjection, const glm::mat4& rightHeadToEye, float nearClip, float farClip )
+{
+	glm::vec3 leftEye{ glm::inverse( leftHeadToEye )[3] };
+	glm::vec3 rightEye{ glm::inverse( rightHeadToEye )[3] };
+	return makeFrustum( headView, ( leftEye + rightEye ) * 0.5f, 0, getEnclosingTangents( leftProjection, rightProjection ), nearClip, farClip );
+}
+
+FrameContext::FrameContext()
+	: mFrameState( nullptr )
+	, mFrameIndex( 0 )
+	, mNumRendered( 0 )
+	, mNumReused( 0 )
+{
+}
+
+void FrameContext::beginFrame( const FrameState& frameState, const SharedFrustum& sharedFrustum )
+{
+	mFrameState = &frameState;
+	mFrameIndex = frameState.frameIndex;
+	mSharedFrustum = sharedFrustum;
+	mNumRendered = 0;
+	mNumReused = 0;
+}
+
+gl::FboRef FrameContext::renderPass( const std::string& name, const glm::ivec2& size, const gl::Fbo::Format& format, const RenderPassFn& renderFn, uint32_t updateDivisor )
+{
+	auto it = mPasses.find( name );
+	if( it != mPasses.end() && it->second.fbo->getSize() == size && mFrameIndex - it->second.lastFrame < std::max( updateDivisor, 1u ) ) {
+		++mNumReused;
+		return it->second.fbo;
+	}
+
+	Pass& pass = mPasses[name];
+	if( ! pass.fbo || pass.fbo->getSize() != size )
+		pass.fbo = gl::Fbo::create( size.x, size.y, format );
+	pass.lastFrame = mFrameIndex;
+
+	{
+		gl::ScopedFramebuffer scopedFbo{ pass.fbo };
+		gl::ScopedViewport scopedViewport{ size };
+		gl::ScopedMatrices scopedMatrices;
+		renderFn( *this );
+	}
+
+	++mNumRendered;
+	return pass.fbo;
+}
+
+gl::FboRef FrameContext::getPass( const std::string& name ) const
+{
+	auto it = mPasses.find( name );
+	return it != mPasses.end() ? it->second.fbo : nullptr;
+}
+
+bool FrameContext::wasPassRendered( const std::string& name ) const
+{
+	auto it = mPasses.find( name );
+	return it != mPasses.end() && it->second.lastFrame == mFrameIndex;
+}
+
+void FrameContext::releasePass( const std::string& name )
+{
+	mPasses.erase( name );
+}
+
+void FrameContext::releasePasses()
+{
+	mPasses.clear();
+}
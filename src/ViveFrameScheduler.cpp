@@ -0,0 +1,119 @@
+#include "ViveFrameScheduler.h"
+
+using namespace std;
+using namespace hmd;
+
+FrameScheduler::FrameScheduler( size_t capacity )
+	: mCapacity( capacity > 0 ? capacity : 1 )
+	, mGrants( 0 )
+	, mStopping( false )
+	, mNumFrames( 0 )
+	, mNumDropped( 0 )
+	, mLastWaitSeconds( 0.0 )
+{
+}
+
+FrameScheduler::~FrameScheduler()
+{
+	stop();
+}
+
+void FrameScheduler::start()
+{
+	if( isRunning() )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mStopping = false;
+		mFrames.clear();
+		// the first wait needs no submitted frame
+		mGrants = 1;
+	}
+	mThread = std::thread( &FrameScheduler::threadLoop, this );
+}
+
+void FrameScheduler::stop()
+{
+	if( ! isRunning() )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mStopping = true;
+	}
+	mWaitAllowed.notify_all();
+	mFrameReady.notify_all();
+	mThread.join();
+}
+
+bool FrameScheduler::pop( PoseFrame& frame, std::chrono::milliseconds timeout )
+{
+	std::unique_lock<std::mutex> lock( mMutex );
+	if( ! mFrameReady.wait_for( lock, timeout, [this] { return ! mFrames.empty() || mStopping; } ) || mFrames.empty() )
+		return false;
+
+	frame = mFrames.front();
+	mFrames.pop_front();
+	return true;
+}
+
+void FrameScheduler::frameSubmitted()
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		++mGrants;
+	}
+	mWaitAllowed.notify_one();
+}
+
+uint64_t FrameScheduler::getNumFrames() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mNumFrames;
+}
+
+uint64_t FrameScheduler::getNumDropped() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mNumDropped;
+}
+
+double FrameScheduler::getLastWaitSeconds() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mLastWaitSeconds;
+}
+
+void FrameScheduler::threadLoop()
+{
+	PoseFrame frame;
+	while( true ) {
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+			mWaitAllowed.wait( lock, [this] { return mGrants > 0 || mStopping; } );
+			if( mStopping )
+				return;
+			--mGrants;
+		}
+
+		// blocks until the compositor is ready for the next frame
+		auto begin = std::chrono::steady_clock::now();
+		vr::VRCompositor()->WaitGetPoses( frame.poses.data(), vr::k_unMaxTrackedDeviceCount, NULL, 0 );
+		frame.timestamp = std::chrono::steady_clock::now();
+		uint64_t vsyncCounter;
+		vr::VRSystem()->GetTimeSinceLastVsync( &frame.secondsSinceVsync, &vsyncCounter );
+
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			frame.index = mNumFrames++;
+			mLastWaitSeconds = std::chrono::duration<double>( frame.timestamp - begin ).count();
+			if( mFrames.size() == mCapacity ) {
+				mFrames.pop_front();
+				++mNumDropped;
+			}
+			mFrames.push_back( frame );
+		}
+		mFrameReady.notify_one();
+	}
+}
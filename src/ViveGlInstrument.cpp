@@ -0,0 +1,339 @@
+#include "ViveGlInstrument.h"
+
+#include "cinder/gl/Context.h"
+
+using namespace ci;
+using namespace std;
+using namespace hmd;
+
+void GlCallStats::reset()
+{
+	framebufferBinds = 0;
+	blits = 0;
+	drawCalls = 0;
+	dispatches = 0;
+	programBinds = 0;
+	vertexArrayBinds = 0;
+	textureBinds = 0;
+	stateChanges = 0;
+	redundantSkipped = 0;
+	bufferUploads = 0;
+	textureUploads = 0;
+	submits = 0;
+	bufferBytes = 0;
+	textureBytes = 0;
+	maskedPixels = 0;
+}
+
+GlCallStats& GlCallStats::operator+=( const GlCallStats& rhs )
+{
+	framebufferBinds += rhs.framebufferBinds;
+	blits += rhs.blits;
+	drawCalls += rhs.drawCalls;
+	dispatches += rhs.dispatches;
+	programBinds += rhs.programBinds;
+	vertexArrayBinds += rhs.vertexArrayBinds;
+	textureBinds += rhs.textureBinds;
+	stateChanges += rhs.stateChanges;
+	redundantSkipped += rhs.redundantSkipped;
+	bufferUploads += rhs.bufferUploads;
+	textureUploads += rhs.textureUploads;
+	submits += rhs.submits;
+	bufferBytes += rhs.bufferBytes;
+	textureBytes += rhs.textureBytes;
+	maskedPixels += rhs.maskedPixels;
+	return *this;
+}
+
+std::ostream& hmd::operator<<( std::ostream& os, const GlCallStats& stats )
+{
+	os << "fbo binds: " << stats.framebufferBinds
+		<< ", blits: " << stats.blits
+		<< ", draws: " << stats.drawCalls
+		<< ", dispatches: " << stats.dispatches
+		<< ", program binds: " << stats.programBinds
+		<< ", vao binds: " << stats.vertexArrayBinds
+		<< ", texture binds: " << stats.textureBinds
+		<< ", state changes: " << stats.stateChanges
+		<< ", redundant skipped: " << stats.redundantSkipped
+		<< ", buffer uploads: " << stats.bufferUploads << " (" << stats.bufferBytes << " bytes)"
+		<< ", texture uploads: " << stats.textureUploads << " (" << stats.textureBytes << " bytes)"
+		<< ", submits: " << stats.submits
+		<< ", masked pixels: " << stats.maskedPixels;
+	return os;
+}
+
+GlInstrument::GlInstrument()
+	: mBackend( BACKEND_GL )
+	, mDirectStateAccessSupported( false )
+	, mDirectStateAccess( false )
+	, mComputeSupported( false )
+	, mRawProgram( 0 )
+	, mNumFrames( 0 )
+{
+}
+
+void GlInstrument::detectCapabilities()
+{
+	auto version = gl::getVersion();
+	auto atLeast = [&version]( int major, int minor ) {
+		return version.first > major || ( version.first == major && version.second >= minor );
+	};
+
+#if CINDER_VIVE_GL_DSA
+	mDirectStateAccessSupported = atLeast( 4, 5 ) || gl::isExtensionAvailable( "GL_ARB_direct_state_access" );
+#else
+	mDirectStateAccessSupported = false;
+#endif
+	mDirectStateAccess = mDirectStateAccessSupported;
+
+#if CINDER_VIVE_GL_COMPUTE
+	mComputeSupported = atLeast( 4, 3 ) || ( gl::isExtensionAvailable( "GL_ARB_compute_shader" ) && gl::isExtensionAvailable( "GL_ARB_shader_image_load_store" ) );
+#else
+	mComputeSupported = false;
+#endif
+}
+
+void GlInstrument::beginFrame()
+{
+	mLastFrame = mCurrent;
+	mTotal += mCurrent;
+	mCurrent.reset();
+	++mNumFrames;
+}
+
+GLuint GlInstrument::getFramebuffer( GLenum target )
+{
+	if( isNull() )
+		return target == GL_READ_FRAMEBUFFER ? mNullState.readFramebuffer : mNullState.drawFramebuffer;
+
+	return gl::context()->getFramebuffer( target == GL_FRAMEBUFFER ? GL_DRAW_FRAMEBUFFER : target );
+}
+
+bool GlInstrument::isEnabled( GLenum cap )
+{
+	if( isNull() ) {
+		auto it = mNullState.caps.find( cap );
+		return it != mNullState.caps.end() && it->second;
+	}
+
+	return gl::context()->getBoolState( cap ) != GL_FALSE;
+}
+
+std::pair<ivec2, ivec2> GlInstrument::getViewport()
+{
+	return isNull() ? mNullState.viewport : gl::context()->getViewport();
+}
+
+void GlInstrument::bindFramebuffer( GLenum target, GLuint framebuffer )
+{
+	bool readBound = target == GL_DRAW_FRAMEBUFFER || getFramebuffer( GL_READ_FRAMEBUFFER ) == framebuffer;
+	bool drawBound = target == GL_READ_FRAMEBUFFER || getFramebuffer( GL_DRAW_FRAMEBUFFER ) == framebuffer;
+	if( readBound && drawBound ) {
+		++mCurrent.redundantSkipped;
+		return;
+	}
+
+	++mCurrent.framebufferBinds;
+	if( isNull() ) {
+		if( target != GL_DRAW_FRAMEBUFFER )
+			mNullState.readFramebuffer = framebuffer;
+		if( target != GL_READ_FRAMEBUFFER )
+			mNullState.drawFramebuffer = framebuffer;
+		return;
+	}
+
+	gl::context()->bindFramebuffer( target, framebuffer );
+}
+
+void GlInstrument::blitFramebuffer( GLuint readFramebuffer, GLuint drawFramebuffer, GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter )
+{
+#if CINDER_VIVE_GL_DSA
+	if( mDirectStateAccess ) {
+		++mCurrent.blits;
+		if( ! isNull() )
+			glBlitNamedFramebuffer( readFramebuffer, drawFramebuffer, srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter );
+		return;
+	}
+#endif
+
+	bindFramebuffer( GL_READ_FRAMEBUFFER, readFramebuffer );
+	bindFramebuffer( GL_DRAW_FRAMEBUFFER, drawFramebuffer );
+
+	++mCurrent.blits;
+	if( ! isNull() )
+		glBlitFramebuffer( srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter );
+}
+
+void GlInstrument::drawElements( GLenum mode, GLsizei count, GLenum type, const void *indices )
+{
+	++mCurrent.drawCalls;
+	if( ! isNull() )
+		glDrawElements( mode, count, type, indices );
+}
+
+void GlInstrument::drawArrays( GLenum mode, GLint first, GLsizei count )
+{
+	++mCurrent.drawCalls;
+	if( ! isNull() )
+		glDrawArrays( mode, first, count );
+}
+
+void GlInstrument::dispatchCompute( GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ )
+{
+	++mCurrent.dispatches;
+#if CINDER_VIVE_GL_COMPUTE
+	if( ! isNull() )
+		glDispatchCompute( numGroupsX, numGroupsY, numGroupsZ );
+#endif
+}
+
+void GlInstrument::bindGlslProg( const gl::GlslProgRef& program )
+{
+	const void *current = isNull() ? mNullState.program : gl::context()->getGlslProg();
+	if( current == program.get() ) {
+		++mCurrent.redundantSkipped;
+		return;
+	}
+
+	++mCurrent.programBinds;
+	if( isNull() ) {
+		mNullState.program = program.get();
+		mNullState.rawProgram = 0;
+	}
+	else {
+		gl::context()->bindGlslProg( program.get() );
+		mRawProgram = 0;
+	}
+}
+
+void GlInstrument::useProgram( GLuint program )
+{
+	// the raw handle is only current while Cinder's cached program is still the reset one
+	const void *cinderProgram = isNull() ? mNullState.program : gl::context()->getGlslProg();
+	GLuint& rawProgram = isNull() ? mNullState.rawProgram : mRawProgram;
+	if( ! cinderProgram && rawProgram == program ) {
+		++mCurrent.redundantSkipped;
+		return;
+	}
+
+	// resetting Cinder's cached program issues a glUseProgram( 0 ) of its own
+	if( cinderProgram )
+		++mCurrent.programBinds;
+	++mCurrent.programBinds;
+	rawProgram = program;
+
+	if( isNull() ) {
+		mNullState.program = nullptr;
+		return;
+	}
+
+	gl::context()->bindGlslProg( nullptr );
+	glUseProgram( program );
+}
+
+void GlInstrument::bindVao( const gl::VaoRef& vao )
+{
+	const void *current = isNull() ? mNullState.vao : gl::context()->getVao();
+	if( current == vao.get() ) {
+		++mCurrent.redundantSkipped;
+		return;
+	}
+
+	++mCurrent.vertexArrayBinds;
+	if( isNull() )
+		mNullState.vao = vao.get();
+	else
+		gl::context()->bindVao( vao.get() );
+}
+
+void GlInstrument::bindTexture( const gl::TextureBaseRef& texture, uint8_t textureUnit )
+{
+	bindTexture( texture->getTarget(), texture->getId(), textureUnit );
+}
+
+void GlInstrument::bindTexture( GLenum target, GLuint texture, uint8_t textureUnit )
+{
+	GLuint current = isNull() ? mNullState.textures[textureUnit] : gl::context()->getTextureBinding( target, textureUnit );
+	if( current == texture ) {
+		++mCurrent.redundantSkipped;
+		return;
+	}
+
+	++mCurrent.textureBinds;
+	if( isNull() )
+		mNullState.textures[textureUnit] = texture;
+	else
+		gl::context()->bindTexture( target, texture, textureUnit );
+}
+
+void GlInstrument::enable( GLenum cap, bool value )
+{
+	if( isEnabled( cap ) == value ) {
+		++mCurrent.redundantSkipped;
+		return;
+	}
+
+	++mCurrent.stateChanges;
+	if( isNull() )
+		mNullState.caps[cap] = value;
+	else
+		gl::context()->enable( cap, value ? GL_TRUE : GL_FALSE );
+}
+
+void GlInstrument::pushColorMask( bool write )
+{
+	++mCurrent.stateChanges;
+	if( ! isNull() ) {
+		GLboolean value = write ? GL_TRUE : GL_FALSE;
+		gl::context()->pushColorMask( value, value, value, value );
+	}
+}
+
+void GlInstrument::popColorMask()
+{
+	++mCurrent.stateChanges;
+	if( ! isNull() )
+		gl::context()->popColorMask();
+}
+
+void GlInstrument::viewport( GLint x, GLint y, GLsizei width, GLsizei height )
+{
+	std::pair<ivec2, ivec2> vp( ivec2( x, y ), ivec2( width, height ) );
+	if( getViewport() == vp ) {
+		++mCurrent.redundantSkipped;
+		return;
+	}
+
+	++mCurrent.stateChanges;
+	if( isNull() )
+		mNullState.viewport = vp;
+	else
+		gl::context()->viewport( vp );
+}
+
+vr::EVRCompositorError GlInstrument::submit( vr::Hmd_Eye eye, const vr::Texture_t& texture, const vr::VRTextureBounds_t *bounds )
+{
+	++mCurrent.submits;
+	if( isNull() )
+		return vr::VRCompositorError_None;
+
+	return vr::VRCompositor()->Submit( eye, &texture, bounds );
+}
+
+void GlInstrument::recordBufferUpload( size_t bytes )
+{
+	++mCurrent.bufferUploads;
+	mCurrent.bufferBytes += bytes;
+}
+
+void GlInstrument::recordTextureUpload( size_t bytes )
+{
+	++mCurrent.textureUploads;
+	mCurrent.textureBytes += bytes;
+}
+
+void GlInstrument::recordMaskedPixels( uint64_t pixels )
+{
+	mCurrent.maskedPixels += pixels;
+}
@@ -0,0 +1,233 @@
+#include "ViveHaptics.h"
+
+#include <algorithm>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <mmsystem.h>
+#pragma comment( lib, "winmm.lib" )
+
+using namespace std;
+using namespace hmd;
+
+HapticWaveform::HapticWaveform()
+	: mNumPoints( 1 )
+	, mDuration( 0.1f )
+	, mRepeatCount( 0 )
+	, mPriority( 0 )
+	, mAxis( 0 )
+{
+	mEnvelope.fill( 0.0f );
+	mEnvelope[0] = 1.0f;
+}
+
+HapticWaveform& HapticWaveform::intensity( float intensity )
+{
+	mEnvelope[0] = std::min( std::max( intensity, 0.0f ), 1.0f );
+	mNumPoints = 1;
+	return *this;
+}
+
+HapticWaveform& HapticWaveform::envelope( std::initializer_list<float> points )
+{
+	mNumPoints = 0;
+	for( float point : points ) {
+		if( mNumPoints == kMaxEnvelopePoints )
+			break;
+		mEnvelope[mNumPoints++] = std::min( std::max( point, 0.0f ), 1.0f );
+	}
+	if( mNumPoints == 0 )
+		intensity( 0.0f );
+
+	return *this;
+}
+
+float HapticWaveform::getIntensity( float t ) const
+{
+	if( mNumPoints == 1 || mDuration <= 0.0f )
+		return mEnvelope[0];
+
+	float x = std::min( std::max( t / mDuration, 0.0f ), 1.0f ) * ( mNumPoints - 1 );
+	size_t i = std::min( static_cast<size_t>( x ), mNumPoints - 2 );
+	float f = x - i;
+	return mEnvelope[i] * ( 1.0f - f ) + mEnvelope[i + 1] * f;
+}
+
+HapticEngine::HapticEngine( vr::IVRSystem *system, std::chrono::microseconds period )
+	: mSystem( system )
+	, mPeriod( period )
+	, mQueueHead( 0 )
+	, mQueueTail( 0 )
+	, mRunning( true )
+	, mIdle( false )
+	, mNumPulses( 0 )
+	, mNumDropped( 0 )
+	, mNumPreempted( 0 )
+	, mNumRejected( 0 )
+{
+	// the default ~15.6 ms scheduler tick would stretch every 5 ms period to a full tick
+	timeBeginPeriod( 1 );
+	mThread = std::thread( &HapticEngine::threadLoop, this );
+}
+
+HapticEngine::~HapticEngine()
+{
+	{
+		std::lock_guard<std::mutex> lock( mWakeMutex );
+		mRunning = false;
+	}
+	mWakeCondition.notify_one();
+	if( mThread.joinable() )
+		mThread.join();
+	timeEndPeriod( 1 );
+}
+
+bool HapticEngine::play( vr::TrackedDeviceIndex_t device, const HapticWaveform& waveform )
+{
+	Command command;
+	command.type = COMMAND_PLAY;
+	command.device = device;
+	command.waveform = waveform;
+	return push( command );
+}
+
+bool HapticEngine::stop( vr::TrackedDeviceIndex_t device )
+{
+	Command command;
+	command.type = COMMAND_STOP;
+	command.device = device;
+	return push( command );
+}
+
+bool HapticEngine::stopAll()
+{
+	Command command;
+	command.type = COMMAND_STOP_ALL;
+	command.device = vr::k_unTrackedDeviceIndexInvalid;
+	return push( command );
+}
+
+bool HapticEngine::push( const Command& command )
+{
+	size_t tail = mQueueTail.load( std::memory_order_relaxed );
+	size_t next = ( tail + 1 ) % kQueueCapacity;
+	if( next == mQueueHead.load( std::memory_order_acquire ) ) {
+		++mNumDropped;
+		return false;
+	}
+
+	mQueue[tail] = command;
+	// sequentially consistent with mIdle, so either this sees the thread idle or the thread sees the command
+	mQueueTail.store( next );
+	if( mIdle.load() ) {
+		std::lock_guard<std::mutex> lock( mWakeMutex );
+		mWakeCondition.notify_one();
+	}
+	return true;
+}
+
+void HapticEngine::waitForCommands()
+{
+	std::unique_lock<std::mutex> lock( mWakeMutex );
+	mIdle = true;
+	mWakeCondition.wait( lock, [this] { return ! mRunning || mQueueHead.load( std::memory_order_relaxed ) != mQueueTail.load(); } );
+	mIdle = false;
+}
+
+void HapticEngine::threadLoop()
+{
+	auto next = std::chrono::steady_clock::now();
+	while( mRunning ) {
+		auto now = std::chrono::steady_clock::now();
+
+		size_t head = mQueueHead.load( std::memory_order_relaxed );
+		while( head != mQueueTail.load( std::memory_order_acquire ) ) {
+			apply( mQueue[head], now );
+			head = ( head + 1 ) % kQueueCapacity;
+			mQueueHead.store( head, std::memory_order_release );
+		}
+
+		// nothing to pulse until the next command, so there's no schedule to keep
+		if( ! tick( now ) ) {
+			waitForCommands();
+			next = std::chrono::steady_clock::now();
+			continue;
+		}
+
+		// sleep_until on a fixed schedule, so the pulse spacing doesn't drift with the work done above
+		next += mPeriod;
+		if( next < now )
+			next = now + mPeriod;
+		std::this_thread::sleep_until( next );
+	}
+}
+
+void HapticEngine::apply( const Command& command, std::chrono::steady_clock::time_point now )
+{
+	if( command.type == COMMAND_STOP_ALL ) {
+		for( auto& channel : mChannels ) {
+			channel.active = false;
+		}
+		return;
+	}
+
+	if( command.device >= vr::k_unMaxTrackedDeviceCount )
+		return;
+
+	Channel& channel = mChannels[command.device];
+	if( command.type == COMMAND_STOP ) {
+		channel.active = false;
+		return;
+	}
+
+	if( channel.active ) {
+		if( command.waveform.getPriority() < channel.waveform.getPriority() ) {
+			++mNumRejected;
+			return;
+		}
+		++mNumPreempted;
+	}
+
+	channel.active = true;
+	channel.waveform = command.waveform;
+	channel.start = now;
+	channel.remainingPlays = command.waveform.getRepeatCount();
+}
+
+bool HapticEngine::tick( std::chrono::steady_clock::time_point now )
+{
+	bool anyActive = false;
+	for( vr::TrackedDeviceIndex_t device = 0; device < vr::k_unMaxTrackedDeviceCount; ++device ) {
+		Channel& channel = mChannels[device];
+		if( ! channel.active )
+			continue;
+
+		float t = std::chrono::duration<float>( now - channel.start ).count();
+		float duration = channel.waveform.getDuration();
+		while( t >= duration ) {
+			if( channel.remainingPlays == 0 || duration <= 0.0f ) {
+				channel.active = false;
+				break;
+			}
+			--channel.remainingPlays;
+			channel.start += std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::duration<float>( duration ) );
+			t -= duration;
+		}
+		if( ! channel.active )
+			continue;
+
+		anyActive = true;
+		// pulse width modulation: the pulse fills a share of the period proportional to intensity
+		auto maxWidth = std::min<long long>( mPeriod.count(), kMaxPulseMicroseconds );
+		auto width = static_cast<unsigned short>( channel.waveform.getIntensity( t ) * maxWidth );
+		if( width == 0 || ! mSystem )
+			continue;
+
+		mSystem->TriggerHapticPulse( device, channel.waveform.getAxis(), width );
+		++mNumPulses;
+	}
+
+	return anyActive;
+}
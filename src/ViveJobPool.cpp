@@ -0,0 +1,57 @@
+#include "ViveJobPool.h"
+
+using namespace std;
+using namespace hmd;
+
+JobPool::JobPool( size_t numThreads )
+	: mStopping( false )
+{
+	if( numThreads == 0 ) {
+		unsigned int hw = std::thread::hardware_concurrency();
+		numThreads = hw > 1 ? hw - 1 : 1;
+	}
+
+	for( size_t i = 0; i < numThreads; ++i ) {
+		mThreads.emplace_back( &JobPool::workerLoop, this );
+	}
+}
+
+JobPool::~JobPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mStopping = true;
+	}
+	mCondition.notify_all();
+
+	for( auto& thread : mThreads ) {
+		thread.join();
+	}
+}
+
+void JobPool::pushJob( std::function<void()> job )
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mJobs.emplace_back( std::move( job ) );
+	}
+	mCondition.notify_one();
+}
+
+void JobPool::workerLoop()
+{
+	for( ;; ) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+			mCondition.wait( lock, [this] { return mStopping || ! mJobs.empty(); } );
+			// drain outstanding jobs before exiting so no future is left without a value
+			if( mJobs.empty() )
+				return;
+
+			job = std::move( mJobs.front() );
+			mJobs.pop_front();
+		}
+		job();
+	}
+}
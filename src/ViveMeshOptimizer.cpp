@@ -0,0 +1,252 @@
+#include "ViveMeshOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace std;
+using namespace hmd;
+
+// Forsyth's scoring constants; the simulated cache is larger than the hardware FIFO on purpose
+static const int	kCacheSize = 32;
+static const float	kLastTriangleScore = 0.75f;
+static const float	kCacheDecayPower = 1.5f;
+static const float	kValenceBoostScale = 2.0f;
+static const float	kValenceBoostPower = 0.5f;
+
+static float vertexScore( int cachePosition, uint32_t remainingTriangles )
+{
+	if( remainingTriangles == 0 )
+		return -1.0f;
+
+	float score = 0.0f;
+	if( cachePosition >= 0 ) {
+		// the triangle just emitted is best reused by the next one, but not scored above the valence boost
+		if( cachePosition < 3 )
+			score = kLastTriangleScore;
+		else
+			score = std::pow( 1.0f - ( cachePosition - 3 ) / float( kCacheSize - 3 ), kCacheDecayPower );
+	}
+
+	// favors vertices with few triangles left, so they retire instead of being reloaded later
+	return score + kValenceBoostScale * std::pow( float( remainingTriangles ), -kValenceBoostPower );
+}
+
+void hmd::optimizeVertexCache( uint16_t* indices, size_t indexCount, size_t vertexCount )
+{
+	size_t triangleCount = indexCount / 3;
+	if( triangleCount == 0 )
+		return;
+
+	// per-vertex lists of the triangles not yet emitted
+	std::vector<uint32_t> remaining( vertexCount, 0 );
+	for( size_t i = 0; i < indexCount; ++i )
+		remaining[indices[i]]++;
+
+	std::vector<uint32_t> offsets( vertexCount + 1, 0 );
+	for( size_t v = 0; v < vertexCount; ++v )
+		offsets[v + 1] = offsets[v] + remaining[v];
+
+	std::vector<uint32_t> adjacency( indexCount );
+	{
+		std::vector<uint32_t> cursor( offsets.begin(), offsets.end() - 1 );
+		for( size_t i = 0; i < indexCount; ++i )
+			adjacency[cursor[indices[i]]++] = static_cast<uint32_t>( i / 3 );
+	}
+
+	std::vector<int> cachePosition( vertexCount, -1 );
+	std::vector<float> scores( vertexCount );
+	for( size_t v = 0; v < vertexCount; ++v )
+		scores[v] = vertexScore( -1, remaining[v] );
+
+	std::vector<float> triangleScores( triangleCount );
+	std::vector<bool> emitted( triangleCount, false );
+	for( size_t t = 0; t < triangleCount; ++t )
+		triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+
+	std::vector<uint16_t> output;
+	output.reserve( indexCount );
+
+	int cache[kCacheSize + 3];
+	int cacheCount = 0;
+	size_t scanStart = 0;
+	int best = static_cast<int>( std::max_element( triangleScores.begin(), triangleScores.end() ) - triangleScores.begin() );
+
+	while( output.size() < triangleCount * 3 ) {
+		if( best < 0 ) {
+			// nothing in the cache has triangles left; restart from the best remaining triangle
+			float bestScore = -1.0f;
+			for( size_t t = scanStart; t < triangleCount; ++t ) {
+				if( emitted[t] )
+					continue;
+				if( bestScore < 0 )
+					scanStart = t;
+				if( triangleScores[t] > bestScore ) {
+					bestScore = triangleScores[t];
+					best = static_cast<int>( t );
+				}
+			}
+		}
+
+		const uint16_t* triangle = indices + best * 3;
+		emitted[best] = true;
+
+		int newCache[kCacheSize + 3];
+		int newCount = 0;
+		for( int k = 0; k < 3; ++k ) {
+			uint16_t v = triangle[k];
+			output.push_back( v );
+			newCache[newCount++] = v;
+
+			// drop the triangle from the vertex's list
+			uint32_t* begin = &adjacency[offsets[v]];
+			uint32_t* end = begin + remaining[v];
+			*std::find( begin, end, static_cast<uint32_t>( best ) ) = *( end - 1 );
+			remaining[v]--;
+		}
+
+		for( int i = 0; i < cacheCount; ++i ) {
+			int v = cache[i];
+			if( v != triangle[0] && v != triangle[1] && v != triangle[2] )
+				newCache[newCount++] = v;
+		}
+
+		// vertices pushed out of the cache lose their position score
+		for( int i = 0; i < newCount; ++i ) {
+			int v = newCache[i];
+			cachePosition[v] = i < kCacheSize ? i : -1;
+			scores[v] = vertexScore( cachePosition[v], remaining[v] );
+		}
+
+		best = -1;
+		float bestScore = -1.0f;
+		for( int i = 0; i < newCount; ++i ) {
+			int v = newCache[i];
+			for( uint32_t a = offsets[v]; a < offsets[v] + remaining[v]; ++a ) {
+				uint32_t t = adjacency[a];
+				float score = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+				triangleScores[t] = score;
+				if( score > bestScore ) {
+					bestScore = score;
+					best = static_cast<int>( t );
+				}
+			}
+		}
+
+		cacheCount = std::min( newCount, kCacheSize );
+		std::copy( newCache, newCache + cacheCount, cache );
+	}
+
+	std::copy( output.begin(), output.end(), indices );
+}
+
+std::vector<uint16_t> hmd::optimizeVertexFetch( uint16_t* indices, size_t indexCount, size_t vertexCount )
+{
+	const uint16_t kUnassigned = 0xFFFF;
+	std::vector<uint16_t> remap( vertexCount, kUnassigned );
+	std::vector<uint16_t> order;
+	order.reserve( vertexCount );
+
+	for( size_t i = 0; i < indexCount; ++i ) {
+		uint16_t& index = remap[indices[i]];
+		if( index == kUnassigned ) {
+			index = static_cast<uint16_t>( order.size() );
+			order.push_back( indices[i] );
+		}
+		indices[i] = index;
+	}
+
+	// unreferenced vertices are dropped
+	return order;
+}
+
+float hmd::computeAcmr( const uint16_t* indices, size_t indexCount, size_t cacheSize )
+{
+	if( indexCount < 3 )
+		return 0.0f;
+
+	std::vector<uint16_t> fifo( cacheSize, 0xFFFF );
+	size_t head = 0, misses = 0;
+	for( size_t i = 0; i < indexCount; ++i ) {
+		if( std::find( fifo.begin(), fifo.end(), indices[i] ) != fifo.end() )
+			continue;
+
+		fifo[head] = indices[i];
+		head = ( head + 1 ) % cacheSize;
+		++misses;
+	}
+
+	return misses / float( indexCount / 3 );
+}
+
+static int16_t quantizeSnorm16( float v )
+{
+	return static_cast<int16_t>( std::floor( glm::clamp( v, -1.0f, 1.0f ) * 32767.0f + 0.5f ) );
+}
+
+static uint16_t quantizeUnorm16( float v )
+{
+	return static_cast<uint16_t>( std::floor( glm::clamp( v, 0.0f, 1.0f ) * 65535.0f + 0.5f ) );
+}
+
+static uint32_t packSnorm1010102( const glm::vec3& n )
+{
+	uint32_t x = static_cast<uint32_t>( static_cast<int32_t>( std::floor( glm::clamp( n.x, -1.0f, 1.0f ) * 511.0f + 0.5f ) ) ) & 0x3FF;
+	uint32_t y = static_cast<uint32_t>( static_cast<int32_t>( std::floor( glm::clamp( n.y, -1.0f, 1.0f ) * 511.0f + 0.5f ) ) ) & 0x3FF;
+	uint32_t z = static_cast<uint32_t>( static_cast<int32_t>( std::floor( glm::clamp( n.z, -1.0f, 1.0f ) * 511.0f + 0.5f ) ) ) & 0x3FF;
+	return x | ( y << 10 ) | ( z << 20 );
+}
+
+QuantizedMesh hmd::optimizeRenderModel( const vr::RenderModel_t& model )
+{
+	QuantizedMesh mesh;
+	size_t indexCount = model.unTriangleCount * 3;
+	mesh.indices.assign( model.rIndexData, model.rIndexData + indexCount );
+	mesh.acmrBefore = computeAcmr( mesh.indices.data(), indexCount );
+
+	optimizeVertexCache( mesh.indices.data(), indexCount, model.unVertexCount );
+	mesh.acmrAfter = computeAcmr( mesh.indices.data(), indexCount );
+	std::vector<uint16_t> order = optimizeVertexFetch( mesh.indices.data(), indexCount, model.unVertexCount );
+
+	glm::vec3 minPosition( FLT_MAX ), maxPosition( -FLT_MAX );
+	glm::vec2 minTexCoord( FLT_MAX ), maxTexCoord( -FLT_MAX );
+	for( uint16_t v : order ) {
+		const vr::RenderModel_Vertex_t& vertex = model.rVertexData[v];
+		glm::vec3 position( vertex.vPosition.v[0], vertex.vPosition.v[1], vertex.vPosition.v[2] );
+		glm::vec2 texCoord( vertex.rfTextureCoord[0], vertex.rfTextureCoord[1] );
+		minPosition = glm::min( minPosition, position );
+		maxPosition = glm::max( maxPosition, position );
+		minTexCoord = glm::min( minTexCoord, texCoord );
+		maxTexCoord = glm::max( maxTexCoord, texCoord );
+	}
+	if( order.empty() ) {
+		minPosition = maxPosition = glm::vec3( 0 );
+		minTexCoord = maxTexCoord = glm::vec2( 0 );
+	}
+
+	// snorm16 spans the bounding box around its center, unorm16 the texture coordinate range
+	mesh.positionOffset = ( minPosition + maxPosition ) * 0.5f;
+	mesh.positionScale = glm::max( ( maxPosition - minPosition ) * 0.5f, glm::vec3( 1e-6f ) );
+	mesh.texCoordOffset = minTexCoord;
+	mesh.texCoordScale = glm::max( maxTexCoord - minTexCoord, glm::vec2( 1e-6f ) );
+
+	mesh.vertices.resize( order.size() );
+	for( size_t i = 0; i < order.size(); ++i ) {
+		const vr::RenderModel_Vertex_t& vertex = model.rVertexData[order[i]];
+		QuantizedVertex& out = mesh.vertices[i];
+
+		glm::vec3 position = ( glm::vec3( vertex.vPosition.v[0], vertex.vPosition.v[1], vertex.vPosition.v[2] ) - mesh.positionOffset ) / mesh.positionScale;
+		out.position[0] = quantizeSnorm16( position.x );
+		out.position[1] = quantizeSnorm16( position.y );
+		out.position[2] = quantizeSnorm16( position.z );
+		out.position[3] = 0;
+
+		out.normal = packSnorm1010102( glm::vec3( vertex.vNormal.v[0], vertex.vNormal.v[1], vertex.vNormal.v[2] ) );
+
+		glm::vec2 texCoord = ( glm::vec2( vertex.rfTextureCoord[0], vertex.rfTextureCoord[1] ) - mesh.texCoordOffset ) / mesh.texCoordScale;
+		out.texCoord[0] = quantizeUnorm16( texCoord.x );
+		out.texCoord[1] = quantizeUnorm16( texCoord.y );
+	}
+
+	return mesh;
+}
@@ -0,0 +1,128 @@
+#include "CinderVive.h"
+
+using namespace ci;
+using namespace std;
+using namespace hmd;
+
+static vr::HmdMatrix34_t convertMat4ToSteamVRMatrix( const glm::mat4& mat )
+{
+	vr::HmdMatrix34_t result;
+	for( int row = 0; row < 3; ++row ) {
+		for( int col = 0; col < 4; ++col ) {
+			result.m[row][col] = mat[col][row];
+		}
+	}
+	return result;
+}
+
+Overlay::Overlay( const std::string& key, const std::string& name, const glm::ivec2& size )
+	: mHandle( vr::k_ulOverlayHandleInvalid )
+	, mKey( key )
+	, mDirty( true )
+	, mVisible( false )
+{
+	if( ! vr::VROverlay() ) {
+		throw ViveExeption{ "Overlay interface unavailable, cannot create overlay " + key };
+	}
+
+	auto error = vr::VROverlay()->CreateOverlay( key.c_str(), name.c_str(), &mHandle );
+	if( ! checkError( error, "CreateOverlay" ) ) {
+		throw ViveExeption{ "Unable to create overlay " + key };
+	}
+
+	gl::Texture2d::Format texFmt;
+	texFmt.internalFormat( GL_RGBA8 ).minFilter( GL_LINEAR ).magFilter( GL_LINEAR ).wrap( GL_CLAMP_TO_EDGE );
+	mFbo = gl::Fbo::create( size.x, size.y, gl::Fbo::Format().colorTexture( texFmt ).disableDepth() );
+}
+
+Overlay::~Overlay()
+{
+	release();
+}
+
+void Overlay::release()
+{
+	if( mHandle != vr::k_ulOverlayHandleInvalid && vr::VROverlay() ) {
+		vr::VROverlay()->DestroyOverlay( mHandle );
+	}
+	mHandle = vr::k_ulOverlayHandleInvalid;
+	mVisible = false;
+}
+
+void Overlay::setWidthInMeters( float width )
+{
+	if( mHandle != vr::k_ulOverlayHandleInvalid )
+		checkError( vr::VROverlay()->SetOverlayWidthInMeters( mHandle, width ), "SetOverlayWidthInMeters" );
+}
+
+void Overlay::setAlpha( float alpha )
+{
+	if( mHandle != vr::k_ulOverlayHandleInvalid )
+		checkError( vr::VROverlay()->SetOverlayAlpha( mHandle, alpha ), "SetOverlayAlpha" );
+}
+
+void Overlay::setSortOrder( uint32_t order )
+{
+	if( mHandle != vr::k_ulOverlayHandleInvalid )
+		checkError( vr::VROverlay()->SetOverlaySortOrder( mHandle, order ), "SetOverlaySortOrder" );
+}
+
+void Overlay::setTransformDeviceRelative( vr::TrackedDeviceIndex_t device, const glm::mat4& transform )
+{
+	if( mHandle == vr::k_ulOverlayHandleInvalid )
+		return;
+
+	vr::HmdMatrix34_t mat = convertMat4ToSteamVRMatrix( transform );
+	checkError( vr::VROverlay()->SetOverlayTransformTrackedDeviceRelative( mHandle, device, &mat ), "SetOverlayTransformTrackedDeviceRelative" );
+}
+
+void Overlay::setTransformAbsolute( const glm::mat4& transform )
+{
+	if( mHandle == vr::k_ulOverlayHandleInvalid )
+		return;
+
+	vr::HmdMatrix34_t mat = convertMat4ToSteamVRMatrix( transform );
+	checkError( vr::VROverlay()->SetOverlayTransformAbsolute( mHandle, vr::TrackingUniverseStanding, &mat ), "SetOverlayTransformAbsolute" );
+}
+
+void Overlay::show()
+{
+	if( mHandle != vr::k_ulOverlayHandleInvalid && checkError( vr::VROverlay()->ShowOverlay( mHandle ), "ShowOverlay" ) )
+		mVisible = true;
+}
+
+void Overlay::hide()
+{
+	if( mHandle != vr::k_ulOverlayHandleInvalid && checkError( vr::VROverlay()->HideOverlay( mHandle ), "HideOverlay" ) )
+		mVisible = false;
+}
+
+bool Overlay::update()
+{
+	if( ! mDirty || ! mRenderFn || mHandle == vr::k_ulOverlayHandleInvalid )
+		return false;
+
+	{
+		gl::ScopedFramebuffer fbo{ mFbo };
+		gl::ScopedViewport viewport{ ivec2( 0 ), mFbo->getSize() };
+		gl::ScopedMatrices matrices;
+		gl::setMatricesWindow( mFbo->getSize() );
+		mRenderFn( mFbo->getSize() );
+	}
+
+	vr::Texture_t texture = { (void*)(uintptr_t)mFbo->getColorTexture()->getId(), vr::API_OpenGL, vr::ColorSpace_Auto };
+	checkError( vr::VROverlay()->SetOverlayTexture( mHandle, &texture ), "SetOverlayTexture" );
+
+	mDirty = false;
+	return true;
+}
+
+bool Overlay::checkError( int error, const char *call ) const
+{
+	if( error == vr::VROverlayError_None )
+		return true;
+
+	const char *name = vr::VROverlay()->GetOverlayErrorNameFromEnum( static_cast<vr::EVROverlayError>( error ) );
+	CI_LOG_E( call << " failed for overlay " << mKey << ": " << ( name ? name : "" ) );
+	return false;
+}
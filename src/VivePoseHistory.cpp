@@ -0,0 +1,158 @@
+#include "VivePoseHistory.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace hmd;
+
+static PoseSample toPoseSample( double time, const vr::TrackedDevicePose_t& pose )
+{
+	const vr::HmdMatrix34_t& m = pose.mDeviceToAbsoluteTracking;
+	glm::mat3 rotation{
+		m.m[0][0], m.m[1][0], m.m[2][0],
+		m.m[0][1], m.m[1][1], m.m[2][1],
+		m.m[0][2], m.m[1][2], m.m[2][2]
+	};
+
+	PoseSample sample;
+	sample.time = time;
+	sample.position = glm::vec3( m.m[0][3], m.m[1][3], m.m[2][3] );
+	sample.orientation = glm::normalize( glm::quat_cast( rotation ) );
+	sample.velocity = glm::vec3( pose.vVelocity.v[0], pose.vVelocity.v[1], pose.vVelocity.v[2] );
+	sample.angularVelocity = glm::vec3( pose.vAngularVelocity.v[0], pose.vAngularVelocity.v[1], pose.vAngularVelocity.v[2] );
+	return sample;
+}
+
+static void extrapolate( const PoseSample& from, double time, PoseSample* result )
+{
+	float dt = static_cast<float>( time - from.time );
+	*result = from;
+	result->time = time;
+	result->position += from.velocity * dt;
+
+	float speed = glm::length( from.angularVelocity );
+	if( speed > 1e-6f )
+		result->orientation = glm::normalize( glm::angleAxis( speed * dt, from.angularVelocity / speed ) * from.orientation );
+}
+
+glm::mat4 PoseSample::toMat4() const
+{
+	glm::mat4 m = glm::mat4_cast( orientation );
+	m[3] = glm::vec4( position, 1 );
+	return m;
+}
+
+PoseHistory::PoseHistory( double windowSeconds, double sampleRate )
+	: mWindow( 0 )
+	, mCapacity( 0 )
+{
+	setWindow( windowSeconds, sampleRate );
+}
+
+void PoseHistory::setWindow( double windowSeconds, double sampleRate )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mWindow = windowSeconds;
+	// one spare sample so the window is covered at both ends
+	mCapacity = std::max<size_t>( 2, static_cast<size_t>( std::ceil( windowSeconds * sampleRate ) ) + 1 );
+	mSamples.assign( mCapacity * vr::k_unMaxTrackedDeviceCount, PoseSample() );
+	for( auto& ring : mRings )
+		ring.start = ring.count = 0;
+}
+
+void PoseHistory::clear()
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	for( auto& ring : mRings )
+		ring.start = ring.count = 0;
+}
+
+void PoseHistory::push( double time, const vr::TrackedDevicePose_t* poses, uint32_t count )
+{
+	count = std::min( count, vr::k_unMaxTrackedDeviceCount );
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	for( vr::TrackedDeviceIndex_t device = 0; device < count; ++device ) {
+		if( ! poses[device].bPoseIsValid )
+			continue;
+
+		Ring& ring = mRings[device];
+		// queries rely on increasing times; a repeated or older prediction replaces nothing
+		if( ring.count > 0 && time <= at( device, ring.count - 1 ).time )
+			continue;
+
+		if( ring.count == mCapacity ) {
+			ring.start = ( ring.start + 1 ) % mCapacity;
+			--ring.count;
+		}
+		mSamples[device * mCapacity + ( ring.start + ring.count ) % mCapacity] = toPoseSample( time, poses[device] );
+		++ring.count;
+	}
+}
+
+bool PoseHistory::sample( vr::TrackedDeviceIndex_t device, double time, PoseSample* result, double maxLookAhead ) const
+{
+	if( device >= vr::k_unMaxTrackedDeviceCount )
+		return false;
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	const Ring& ring = mRings[device];
+	if( ring.count == 0 || time < at( device, 0 ).time )
+		return false;
+
+	const PoseSample& newest = at( device, ring.count - 1 );
+	if( time >= newest.time ) {
+		extrapolate( newest, std::min( time, newest.time + maxLookAhead ), result );
+		return true;
+	}
+
+	// first sample later than time; there is one, and it isn't the oldest
+	size_t lo = 1, hi = ring.count - 1;
+	while( lo < hi ) {
+		size_t mid = ( lo + hi ) / 2;
+		if( at( device, mid ).time <= time )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	const PoseSample& a = at( device, lo - 1 );
+	const PoseSample& b = at( device, lo );
+	float t = static_cast<float>( ( time - a.time ) / ( b.time - a.time ) );
+
+	result->time = time;
+	result->position = glm::mix( a.position, b.position, t );
+	result->orientation = glm::slerp( a.orientation, b.orientation, t );
+	result->velocity = glm::mix( a.velocity, b.velocity, t );
+	result->angularVelocity = glm::mix( a.angularVelocity, b.angularVelocity, t );
+	return true;
+}
+
+bool PoseHistory::getNewest( vr::TrackedDeviceIndex_t device, PoseSample* result ) const
+{
+	if( device >= vr::k_unMaxTrackedDeviceCount )
+		return false;
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	const Ring& ring = mRings[device];
+	if( ring.count == 0 )
+		return false;
+
+	*result = at( device, ring.count - 1 );
+	return true;
+}
+
+void PoseHistory::getTimeRange( vr::TrackedDeviceIndex_t device, double* oldest, double* newest ) const
+{
+	*oldest = *newest = 0;
+	if( device >= vr::k_unMaxTrackedDeviceCount )
+		return;
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	const Ring& ring = mRings[device];
+	if( ring.count > 0 ) {
+		*oldest = at( device, 0 ).time;
+		*newest = at( device, ring.count - 1 ).time;
+	}
+}
@@ -0,0 +1,234 @@
+#include "ViveProgramCache.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#include "cinder/Log.h"
+
+using namespace ci;
+using namespace std;
+using namespace hmd;
+
+static const uint32_t kBinaryMagic = 0x42505643; // "CVPB"
+
+// the error code type of whichever filesystem library Cinder picked in cinder/Filesystem.h
+#if defined( CINDER_WINRT ) || ( defined( _MSC_VER ) && ( _MSC_VER >= 1900 ) )
+typedef std::error_code FsErrorCode;
+#else
+typedef boost::system::error_code FsErrorCode;
+#endif
+
+static uint64_t fnv1a( uint64_t hash, const std::string& str )
+{
+	for( unsigned char c : str ) {
+		hash ^= c;
+		hash *= 0x100000001b3ULL;
+	}
+	// separator, so moving characters between strings changes the key
+	hash ^= 0xff;
+	hash *= 0x100000001b3ULL;
+	return hash;
+}
+
+static std::string getGlString( GLenum name )
+{
+	auto str = reinterpret_cast<const char *>( glGetString( name ) );
+	return str ? str : "";
+}
+
+static GLuint compileShader( GLenum type, const std::string& source )
+{
+	GLuint shader = glCreateShader( type );
+	const char *src = source.c_str();
+	glShaderSource( shader, 1, &src, nullptr );
+	glCompileShader( shader );
+
+	GLint status = GL_FALSE;
+	glGetShaderiv( shader, GL_COMPILE_STATUS, &status );
+	if( status != GL_TRUE ) {
+		GLint length = 0;
+		glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &length );
+		std::string log( std::max( length, 1 ), '\0' );
+		glGetShaderInfoLog( shader, length, nullptr, &log[0] );
+		CI_LOG_E( "Shader compilation failed: " << log );
+		glDeleteShader( shader );
+		return 0;
+	}
+
+	return shader;
+}
+
+static bool isLinked( GLuint program )
+{
+	GLint status = GL_FALSE;
+	glGetProgramiv( program, GL_LINK_STATUS, &status );
+	return status == GL_TRUE;
+}
+
+ProgramBinaryCache::ProgramBinaryCache()
+	: mSupported( false )
+	, mQueriedSupport( false )
+	, mNumHits( 0 )
+	, mNumMisses( 0 )
+{
+}
+
+GLuint ProgramBinaryCache::createProgram( const std::string& vertex, const std::string& fragment )
+{
+	Stages stages;
+	stages.push_back( std::make_pair( GL_VERTEX_SHADER, &vertex ) );
+	stages.push_back( std::make_pair( GL_FRAGMENT_SHADER, &fragment ) );
+	return build( stages );
+}
+
+GLuint ProgramBinaryCache::createComputeProgram( const std::string& compute )
+{
+#if defined( GL_COMPUTE_SHADER )
+	Stages stages;
+	stages.push_back( std::make_pair( GL_COMPUTE_SHADER, &compute ) );
+	return build( stages );
+#else
+	CI_LOG_E( "Compute shaders are not available in this build." );
+	return 0;
+#endif
+}
+
+GLuint ProgramBinaryCache::build( const Stages& stages )
+{
+	if( ! mQueriedSupport ) {
+		GLint numFormats = 0;
+		glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats );
+		mSupported = numFormats > 0;
+		mDriver = getGlString( GL_VENDOR ) + "|" + getGlString( GL_RENDERER ) + "|" + getGlString( GL_VERSION );
+		mQueriedSupport = true;
+	}
+
+	bool persist = mSupported && ! mDirectory.empty();
+	uint64_t key = persist ? hashSources( stages ) : 0;
+	if( persist ) {
+		GLuint program = loadBinary( key );
+		if( program ) {
+			++mNumHits;
+			return program;
+		}
+	}
+	++mNumMisses;
+
+	std::vector<GLuint> shaders;
+	bool compiled = true;
+	for( const auto& stage : stages ) {
+		shaders.push_back( compileShader( stage.first, *stage.second ) );
+		compiled = compiled && shaders.back();
+	}
+	if( ! compiled ) {
+		for( GLuint shader : shaders ) {
+			glDeleteShader( shader );
+		}
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	for( GLuint shader : shaders ) {
+		glAttachShader( program, shader );
+	}
+	if( persist )
+		glProgramParameteri( program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+	glLinkProgram( program );
+	for( GLuint shader : shaders ) {
+		glDetachShader( program, shader );
+		glDeleteShader( shader );
+	}
+
+	if( ! isLinked( program ) ) {
+		CI_LOG_E( "Program link failed." );
+		glDeleteProgram( program );
+		return 0;
+	}
+
+	if( persist )
+		storeBinary( key, program );
+
+	return program;
+}
+
+uint64_t ProgramBinaryCache::hashSources( const Stages& stages ) const
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	hash = fnv1a( hash, mDriver );
+	for( const auto& stage : stages ) {
+		hash = fnv1a( hash, std::to_string( stage.first ) );
+		hash = fnv1a( hash, *stage.second );
+	}
+	return hash;
+}
+
+fs::path ProgramBinaryCache::getEntryPath( uint64_t key ) const
+{
+	std::ostringstream name;
+	name << std::hex << std::setw( 16 ) << std::setfill( '0' ) << key << ".glbin";
+	return mDirectory / name.str();
+}
+
+GLuint ProgramBinaryCache::loadBinary( uint64_t key )
+{
+	std::ifstream file( getEntryPath( key ).string(), std::ios::binary );
+	if( ! file )
+		return 0;
+
+	uint32_t magic = 0;
+	GLenum format = 0;
+	file.read( reinterpret_cast<char *>( &magic ), sizeof( magic ) );
+	file.read( reinterpret_cast<char *>( &format ), sizeof( format ) );
+	std::vector<char> binary( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+	if( magic != kBinaryMagic || binary.empty() )
+		return 0;
+
+	// drivers may still reject a binary that matches the key, e.g. after a silent update
+	GLuint program = glCreateProgram();
+	glProgramBinary( program, format, binary.data(), static_cast<GLsizei>( binary.size() ) );
+	if( ! isLinked( program ) ) {
+		CI_LOG_W( "Discarding stale program binary " << getEntryPath( key ).string() );
+		glDeleteProgram( program );
+		// the cache is optional, a locked entry is only retried next run
+		FsErrorCode error;
+		fs::remove( getEntryPath( key ), error );
+		if( error )
+			CI_LOG_W( "Unable to remove " << getEntryPath( key ).string() << ": " << error.message() );
+		return 0;
+	}
+
+	return program;
+}
+
+void ProgramBinaryCache::storeBinary( uint64_t key, GLuint program )
+{
+	GLint length = 0;
+	glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+	if( length <= 0 )
+		return;
+
+	std::vector<char> binary( length );
+	GLenum format = 0;
+	glGetProgramBinary( program, length, nullptr, &format, binary.data() );
+
+	FsErrorCode error;
+	if( ! fs::exists( mDirectory, error ) && ! error )
+		fs::create_directories( mDirectory, error );
+	if( error ) {
+		CI_LOG_W( "Unable to create the program cache directory " << mDirectory.string() << ": " << error.message() );
+		return;
+	}
+
+	std::ofstream file( getEntryPath( key ).string(), std::ios::binary | std::ios::trunc );
+	if( ! file ) {
+		CI_LOG_W( "Unable to write program binary " << getEntryPath( key ).string() );
+		return;
+	}
+
+	file.write( reinterpret_cast<const char *>( &kBinaryMagic ), sizeof( kBinaryMagic ) );
+	file.write( reinterpret_cast<const char *>( &format ), sizeof( format ) );
+	file.write( binary.data(), binary.size() );
+}
@@ -0,0 +1,124 @@
+#include "CinderVive.h"
+
+using namespace std;
+using namespace hmd;
+
+RenderModelStats::RenderModelStats()
+	: numModels( 0 )
+	, numResident( 0 )
+	, numReferenced( 0 )
+	, residentBytes( 0 )
+	, referencedBytes( 0 )
+	, loads( 0 )
+	, reloads( 0 )
+	, hits( 0 )
+	, evictions( 0 )
+{
+}
+
+RenderModelManager::RenderModelManager( const LoadFn& loadFn, uint64_t budgetBytes )
+	: mLoadFn( loadFn )
+	, mBudget( budgetBytes )
+{
+}
+
+RenderModelRef RenderModelManager::acquire( const std::string& name )
+{
+	auto inserted = mEntries.insert( std::make_pair( name, Entry() ) );
+	Entry& entry = inserted.first->second;
+
+	if( entry.model ) {
+		++mStats.hits;
+		if( entry.refCount == 0 )
+			mLru.erase( entry.lruIt );
+	}
+	else {
+		entry.model = mLoadFn( name );
+		if( ! entry.model ) {
+			if( inserted.second )
+				mEntries.erase( inserted.first );
+			return nullptr;
+		}
+
+		entry.bytes = entry.model->getGpuBytes();
+		if( inserted.second ) {
+			++mStats.numModels;
+			++mStats.loads;
+		}
+		else {
+			++mStats.reloads;
+		}
+		++mStats.numResident;
+		mStats.residentBytes += entry.bytes;
+	}
+
+	if( entry.refCount++ == 0 ) {
+		++mStats.numReferenced;
+		mStats.referencedBytes += entry.bytes;
+	}
+
+	// a new resident model may push unreferenced ones out
+	enforceBudget();
+	return entry.model;
+}
+
+void RenderModelManager::release( const std::string& name )
+{
+	auto it = mEntries.find( name );
+	if( it == mEntries.end() || it->second.refCount == 0 ) {
+		CI_LOG_W( "Render model " << name << " released more often than acquired." );
+		return;
+	}
+
+	Entry& entry = it->second;
+	if( --entry.refCount > 0 )
+		return;
+
+	--mStats.numReferenced;
+	mStats.referencedBytes -= entry.bytes;
+	entry.lruIt = mLru.insert( mLru.end(), &entry );
+	enforceBudget();
+}
+
+bool RenderModelManager::isResident( const std::string& name ) const
+{
+	auto it = mEntries.find( name );
+	return it != mEntries.end() && it->second.model;
+}
+
+void RenderModelManager::setBudget( uint64_t bytes )
+{
+	mBudget = bytes;
+	enforceBudget();
+}
+
+void RenderModelManager::evictUnreferenced()
+{
+	while( ! mLru.empty() ) {
+		evict( *mLru.front() );
+	}
+}
+
+void RenderModelManager::clear()
+{
+	mLru.clear();
+	mEntries.clear();
+	mStats = RenderModelStats();
+}
+
+void RenderModelManager::evict( Entry& entry )
+{
+	mLru.erase( entry.lruIt );
+	entry.model.reset();
+
+	--mStats.numResident;
+	mStats.residentBytes -= entry.bytes;
+	++mStats.evictions;
+}
+
+void RenderModelManager::enforceBudget()
+{
+	while( mStats.residentBytes > mBudget && ! mLru.empty() ) {
+		evict( *mLru.front() );
+	}
+}
@@ -0,0 +1,198 @@
+#include "ViveUploadService.h"
+
+#include "cinder/Log.h"
+
+using namespace ci;
+using namespace std;
+using namespace hmd;
+
+UploadStats::UploadStats()
+	: textures( 0 )
+	, buffers( 0 )
+	, batches( 0 )
+	, bytes( 0 )
+	, stagingBytes( 0 )
+{
+}
+
+UploadService::UploadService()
+	: mNumUploading( 0 )
+	, mStopping( false )
+	, mStagingBuffer( 0 )
+	, mStagingSize( 0 )
+	, mStagingOffset( 0 )
+{
+	// created here, the render context has to be current to share its objects
+	auto context = gl::Context::create( gl::context() );
+	mThread = std::thread( &UploadService::workerLoop, this, context );
+}
+
+UploadService::~UploadService()
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mStopping = true;
+	}
+	mCondition.notify_all();
+	mThread.join();
+}
+
+std::shared_future<gl::Texture2dRef> UploadService::uploadTexture( const Surface8u& surface, const gl::Texture2d::Format& format )
+{
+	// the caller's pixels may be gone by the time the worker gets to them
+	auto pixels = std::make_shared<Surface8u>( surface.clone() );
+	return enqueue<gl::Texture2dRef>( [this, pixels, format] { return createTexture( *pixels, format ); } );
+}
+
+std::shared_future<gl::Texture2dRef> UploadService::uploadTexture( const ImageSourceRef& source, const gl::Texture2d::Format& format )
+{
+	return enqueue<gl::Texture2dRef>( [this, source, format] { return createTexture( Surface8u( source ), format ); } );
+}
+
+std::shared_future<gl::VboRef> UploadService::uploadBuffer( GLenum target, std::vector<uint8_t> data, GLenum usage )
+{
+	auto bytes = std::make_shared<std::vector<uint8_t>>( std::move( data ) );
+	return enqueue<gl::VboRef>( [this, target, bytes, usage] {
+		auto vbo = gl::Vbo::create( target, bytes->size(), bytes->data(), usage );
+		std::lock_guard<std::mutex> lock( mMutex );
+		++mStats.buffers;
+		mStats.bytes += bytes->size();
+		return vbo;
+	} );
+}
+
+size_t UploadService::getNumPending() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mJobs.size() + mNumUploading;
+}
+
+UploadStats UploadService::getStats() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mStats;
+}
+
+void UploadService::pushJob( Job job )
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mJobs.emplace_back( std::move( job ) );
+	}
+	mCondition.notify_one();
+}
+
+size_t UploadService::allocateStaging( size_t bytes )
+{
+	if( mStagingOffset + bytes > mStagingSize ) {
+		// orphaned, uploads already issued from the old storage keep it alive in the driver
+		mStagingSize = std::max( bytes, mStagingSize * 2 );
+		glBufferData( GL_PIXEL_UNPACK_BUFFER, mStagingSize, nullptr, GL_STREAM_DRAW );
+		mStagingOffset = 0;
+
+		std::lock_guard<std::mutex> lock( mMutex );
+		mStats.stagingBytes = mStagingSize;
+	}
+
+	size_t offset = mStagingOffset;
+	// row starts stay aligned for the driver's copy
+	mStagingOffset = ( mStagingOffset + bytes + 255 ) & ~size_t( 255 );
+	return offset;
+}
+
+gl::Texture2dRef UploadService::createTexture( const Surface8u& source, const gl::Texture2d::Format& format )
+{
+	Surface8u converted;
+	const Surface8u *surface = &source;
+	if( source.getChannelOrder() != SurfaceChannelOrder::RGBA ) {
+		converted = Surface8u( source.getWidth(), source.getHeight(), true, SurfaceChannelOrder::RGBA );
+		converted.copyFrom( source, source.getBounds() );
+		surface = &converted;
+	}
+
+	const int width = surface->getWidth();
+	const int height = surface->getHeight();
+	const size_t bytes = surface->getRowBytes() * height;
+
+	// allocated before the staging buffer is bound, a null pointer would read from it otherwise
+	auto texture = gl::Texture2d::create( width, height, format );
+
+	gl::ScopedBuffer scopedBuffer{ GL_PIXEL_UNPACK_BUFFER, mStagingBuffer };
+	size_t offset = allocateStaging( bytes );
+	// unsynchronized, the range was last read by a batch whose fence has already been waited on
+	void *staging = glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+	if( ! staging )
+		throw std::runtime_error( "Unable to map the upload staging buffer." );
+	memcpy( staging, surface->getData(), bytes );
+	glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+
+	{
+		gl::ScopedTextureBind scopedTexture{ texture };
+		glPixelStorei( GL_UNPACK_ROW_LENGTH, static_cast<GLint>( surface->getRowBytes() / 4 ) );
+		glTexSubImage2D( texture->getTarget(), 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (const GLvoid *)offset );
+		glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+		if( format.hasMipmapping() )
+			glGenerateMipmap( texture->getTarget() );
+	}
+	texture->setTopDown( true );
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	++mStats.textures;
+	mStats.bytes += bytes;
+	return texture;
+}
+
+void UploadService::workerLoop( gl::ContextRef context )
+{
+	context->makeCurrent();
+	glGenBuffers( 1, &mStagingBuffer );
+
+	for( ;; ) {
+		std::deque<Job> batch;
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+			mCondition.wait( lock, [this] { return mStopping || ! mJobs.empty(); } );
+			// drain outstanding jobs before exiting so no future is left without a value
+			if( mJobs.empty() )
+				break;
+
+			batch.swap( mJobs );
+			mNumUploading = batch.size();
+		}
+
+		std::vector<std::exception_ptr> errors( batch.size() );
+		for( size_t i = 0; i < batch.size(); ++i ) {
+			try {
+				batch[i].upload();
+			}
+			catch( ... ) {
+				errors[i] = std::current_exception();
+			}
+		}
+
+		// objects modified by one context are only safe to bind in another once the modifications completed
+		GLsync fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		GLenum status = GL_TIMEOUT_EXPIRED;
+		while( status == GL_TIMEOUT_EXPIRED ) {
+			status = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64( 100000000 ) );
+		}
+		glDeleteSync( fence );
+		if( status == GL_WAIT_FAILED )
+			CI_LOG_E( "Waiting on the upload fence failed, resolving the batch anyway." );
+		mStagingOffset = 0;
+
+		for( size_t i = 0; i < batch.size(); ++i ) {
+			if( errors[i] )
+				batch[i].fail( errors[i] );
+			else
+				batch[i].complete();
+		}
+
+		std::lock_guard<std::mutex> lock( mMutex );
+		mNumUploading = 0;
+		++mStats.batches;
+	}
+
+	glDeleteBuffers( 1, &mStagingBuffer );
+	mStagingBuffer = 0;
+}